@@ -2,6 +2,9 @@
 /* SECTION: includes                                       */
 /* ------------------------------------------------------- */
 
+// needed for CPU affinity (pthread_setaffinity_np, CPU_SET) in real-time mode
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -12,14 +15,19 @@
 #include <time.h>
 
 #include <errno.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
 
+#include "mm-telemetry.h"
+#include "mm-dataset.h"
+
 /* --------------------------------------------------------------------------- */
 /* Config settings */
 /* you can use CPP flags to e.g. print extra debugging messages */
@@ -43,11 +51,81 @@
 #define DELAY 200
 // in micro-seconds: 3s
 #define TIMEOUT 3000000
+// adaptive input window: a digit ends WINDOW_FACTOR times the player's usual gap between presses after the last
+// press, but never sooner than WINDOW_MIN nor later than WINDOW_MAX us (defaults of -W adaptive)
+#define WINDOW_FACTOR 3
+#define WINDOW_MIN 500000
+#define WINDOW_MAX TIMEOUT
+// logging: records per producer ring (a power of 2), max. number of producer threads and of arguments per record
+#define LOG_RING_SIZE 1024
+#define LOG_MAX_PRODUCERS 8
+#define LOG_MAX_ARGS 6
+// logging: how long the writer thread sleeps when all rings are empty, in us
+#define LOG_IDLE_SLEEP 1000
+// hints (-H): the cache holds at most this many histories and this many bytes of compressed candidate sets
+#define HINT_CACHE_ENTRIES 4096
+#define HINT_CACHE_BYTES (4 * 1024 * 1024)
+#define HINT_CACHE_BUCKETS 1021
+// hints (-H): up to this many codes in the configuration, every code is tried as next guess, not just the candidates
+#define HINT_FULL_SPACE 4096
+// hints (-H): exact hints (no -B) are only given up to this many codes; 7x5 takes about 0.2 s a hint, 8x5 about 6 s
+#define HINT_EXACT_MAX 20000
+// stations (-S): max. number of stations, LED steps that can be queued per station, and time between input scans in us
+#define MAX_STATIONS 4
+#define STATION_STEPS 256
+#define SCAN_PERIOD 500
+// LED feedback: software PWM period in us, split into PWM_LEVELS brightness levels (one per SCAN_PERIOD); the fast
+// protocol (-F fast) shows a 1 as a pulse at brightness PWM_DIM, and its default time unit is FAST_UNIT us
+#define PWM_PERIOD 8000
+#define PWM_LEVELS 16
+#define PWM_DIM 3
+#define FAST_UNIT 80000
+// evil codemaker (-E): largest code space it plays in (every station keeps that many candidates, 9 bytes each)
+#define EVIL_MAX_CODES (1 << 20)
+// candidate files (-O): codes per block streamed through the filter, blocks in flight per filter thread, and the
+// size of the file buffers in bytes
+#define STREAM_BLOCK (1 << 15)
+#define STREAM_SLOTS_PER_WORKER 2
+#define STREAM_IO_BUFFER (1 << 20)
+// dataset export (-X): rows buffered per producer thread before they are written (a multiple of 4096, so every
+// write of a full chunk is page-aligned), largest code space, and most guesses per game
+#define EXPORT_CHUNK (1 << 16)
+#define EXPORT_MAX_CODES (1 << 20)
+#define EXPORT_MAX_ROUNDS 64
+// expected-case solver (-A): largest code space (every code is tried as a guess at every node), and entries of its
+// memo table (a power of 2)
+#define EXPSOLVE_MAX_CODES 4096
+#define EXPSOLVE_MEMO (1 << 20)
+// self-test (-T feedback): max. number of LED changes recorded per feedback
+#define LED_RECORD_MAX 4096
+// solver: codes are enumerated in blocks of this many; spaces of at least PARALLEL_MIN_CODES codes are split over up
+// to MAX_WORKERS threads
+#define FILTER_BLOCK 4096
+#define PARALLEL_MIN_CODES (1 << 16)
+#define MAX_WORKERS 16
+// hints with a budget (-B): guesses are first scored against this many candidates, and the best HINT_TOPK of them
+// are then scored exactly
+#define HINT_SAMPLE 256
+#define HINT_TOPK 16
+// button sampling: default time between samples and settle time of the debouncer, in us; events in the ring (power of 2)
+#define SAMPLE_PERIOD 1000
+#define DEBOUNCE_TIME 10000
+#define EVENT_RING_SIZE 256
+// real-time mode (-R): SCHED_FIFO priority of the sampling thread
+#define RT_PRIORITY 80
+// real-time mode (-R): resolution of the jitter histogram is 1us; anything above this many us lands in the last bucket
+#define JITTER_BUCKETS 4096
 // =======================================================
 // APP constants   ---------------------------------
 // number of colours and length of the sequence
 #define COLS 3
 #define SEQL 3
+// limits of -C/-L when playing: sequences are read one decimal digit per peg, and feedback is scored as two decimal
+// digits; only the stream filter (-O/-I), which never scores into decimal, goes up to 15 of each
+#define MAX_COLS 9
+#define MAX_SEQL 8
+#define STREAM_MAX_COLS 15
+#define STREAM_MAX_SEQL 15
 // =======================================================
 
 // generic constants
@@ -66,6 +144,11 @@
 #define LOW 0
 #define HIGH 1
 
+// log levels: LOG_OUT is always shown, LOG_VERBOSE with -v, LOG_DEBUG with -d
+#define LOG_OUT 0
+#define LOG_VERBOSE 1
+#define LOG_DEBUG 2
+
 // =======================================================
 // Wiring (see inlined initialisation routine)
 
@@ -97,8 +180,9 @@ static unsigned char newChar[8] =
 
 /* Constants */
 
-static const int colors = COLS;
-static const int seqlen = SEQL;
+// (COLS and SEQL unless set with -C and -L)
+static int colors = COLS;
+static int seqlen = SEQL;
 
 static char *color_names[] = {"red", "green", "blue"};
 
@@ -124,6 +208,9 @@ static int timed_out = 0;
 // misc prototypes
 
 int failure(int fatal, const char *message, ...);
+void logMsg(int level, FILE *out, const char *fmt, ...);
+void logSync(void);
+void logShutdown(void);
 void waitForEnter(void);
 void waitForButton(uint32_t *gpio, int button);
 
@@ -316,135 +403,453 @@ int readButton(uint32_t *gpio, int button)
 void waitForButton(uint32_t *gpio, int button);
 
 /* ======================================================= */
-/* SECTION: game logic                                     */
+/* SECTION: rule variants                                  */
 /* ------------------------------------------------------- */
-/* AUX fcts of the game logic */
+/* codes are packed 4 bits per peg into a code_t (peg i in bits 4i..4i+3), which covers every configuration up */
+/* to 15 colours x 16 pegs; colour 0 is the blank. Feedback is packed as FB(exact, approx).                     */
+/* Each rule variant is a pair of compile-time policies (may the secret repeat colours, are blanks allowed),    */
+/* and VARIANT_KERNELS instantiates specialised scoring, filtering, generation and ranking functions for it,    */
+/* so the hot loops never test the rules at run time. The variant is picked once with -V.                       */
+
+typedef uint64_t code_t;
+
+#define PEG(code, i) ((int)(((code) >> (4 * (i))) & 0xF))
+#define FB(exact, approx) (((exact) << 4) | (approx))
+#define FB_EXACT(fb) ((fb) >> 4)
+#define FB_APPROX(fb) ((fb)&0xF)
+#define FB_CLASSES 256
+
+// name, duplicates allowed, blanks allowed
+#define VARIANTS(X)      \
+  X(classic, 1, 0)       \
+  X(nodup, 0, 0)         \
+  X(blanks, 1, 1)
+
+/* the kernels of one variant; see VARIANT_KERNELS */
+struct variant
+{
+  const char *name;
+  int dups, blanks;
+  int (*score)(code_t secret, code_t guess, int len);
+  size_t (*filter)(code_t *codes, size_t n, code_t guess, int fb, int len);
+  int (*partition)(const code_t *codes, size_t n, code_t guess, int len, unsigned int *part);
+  int (*classify)(const code_t *codes, size_t n, code_t guess, int len, uint8_t *cls, unsigned int *part);
+  code_t (*gen)(unsigned int *seed, int colors, int len);
+  uint64_t (*size)(int colors, int len);
+  uint64_t (*rank)(code_t c, int colors, int len);
+  code_t (*unrank)(uint64_t r, int colors, int len);
+  int (*next)(code_t *c, int colors, int len);
+};
+
+/* pack a sequence of @len@ ints (as used by the game) into a code, and back */
+code_t packSeq(const int *seq, int len)
+{
+  code_t c = 0;
 
+  for (int i = 0; i < len; i++)
+    c |= (code_t)(seq[i] & 0xF) << (4 * i);
+  return c;
+}
 
-/* initialise the secret sequence; by default it should be a random sequence */
-void initSeq()
+void unpackSeq(code_t c, int *seq, int len)
 {
+  for (int i = 0; i < len; i++)
+    seq[i] = PEG(c, i);
+}
+
+/* ------------------------------------------------------- */
+/* generic rule bodies; always inlined with constant @dups@/@blanks@, so each variant gets its own straight code */
 
-  // We initialise the random number generator, using the time as the seed
+/* number of pegs on which @a@ and @b@ agree: we fold every nibble of a ^ b onto its lowest bit and count */
+static inline __attribute__((always_inline)) int exactPegs(code_t a, code_t b, int len)
+{
+  code_t x = a ^ b;
+
+  x |= x >> 2;
+  x |= x >> 1;
+  x &= 0x1111111111111111ULL;
+  if (len < 16)
+    x &= (((code_t)1) << (4 * len)) - 1;
+  return len - __builtin_popcountll(x);
+}
 
-  srand(time(NULL));
+/* bit c is set iff colour c occurs in @a@ */
+static inline __attribute__((always_inline)) unsigned int colourMask(code_t a, int len)
+{
+  unsigned int m = 0;
 
-  // We malloc and instantiate our array theSeq
+  for (int i = 0; i < len; i++)
+    m |= 1u << PEG(a, i);
+  return m;
+}
 
-  theSeq = (int *)malloc(seqlen * sizeof(int));
+static inline __attribute__((always_inline)) int scoreRules(code_t secret, code_t guess, int len, int dups, int blanks)
+{
+  int exact = exactPegs(secret, guess, len), common = 0;
 
-  for (int i = 0; i < seqlen; i++)
+  if (!dups)
   {
+    // Without duplicates in the secret every colour counts at most once: the colours in common are just the
+    // bits the two colour masks share.
 
-    // We add the randomly generated value as an element to the array. As per our coursework specs and the following code,
-    // the randomly generated numbers will range between only 1 to 3.
+    common = __builtin_popcount(colourMask(secret, len) & colourMask(guess, len));
+  }
+  else
+  {
+    unsigned char left[16] = {0};
 
-    theSeq[i] = (rand() % 3) + 1;
+    for (int i = 0; i < len; i++)
+      left[PEG(secret, i)]++;
+    for (int i = 0; i < len; i++)
+      if (left[PEG(guess, i)])
+      {
+        left[PEG(guess, i)]--;
+        common++;
+      }
   }
+  (void)blanks; // a blank scores like any other colour
+  return FB(exact, common - exact);
 }
 
-/* display the sequence on the terminal window, using the format from the sample run in the spec */
-void showSeq(int *seq)
+static inline __attribute__((always_inline)) uint64_t sizeRules(int colors, int len, int dups, int blanks)
 {
-  fprintf(stdout, "The secret sequence is: %d %d %d\n", seq[0], seq[1], seq[2]);
-}
+  uint64_t size = 1;
+  int symbols = colors + (blanks ? 1 : 0);
 
-#define NAN1 8
-#define NAN2 9
+  for (int i = 0; i < len; i++)
+    size *= dups ? symbols : symbols - i;
+  return size;
+}
 
-/* counts how many entries in seq2 match entries in seq1 */
-/* returns exact and approximate matches, either both encoded in one value, */
-/* or as a pointer to a pair of values */
-int /* or int* */ countMatches(int *seq1, int *seq2)
+/* rank of @c@: with duplicates the pegs are the digits of a base-colours number (peg 0 lowest); without, the */
+/* peg i digit is the index of its colour among the colours not used by the higher pegs                        */
+static inline __attribute__((always_inline)) uint64_t rankRules(code_t c, int colors, int len, int dups, int blanks)
 {
-  /* ***  COMPLETE the code here  ***  */
+  uint64_t r = 0;
+  int low = blanks ? 0 : 1, symbols = colors + (blanks ? 1 : 0);
+  unsigned int used = 0;
 
-  // We instantiate the matchesFound variable
-
-  int matchesFound;
+  for (int i = len - 1; i >= 0; i--)
+  {
+    int p = PEG(c, i) - low;
 
-  // We instantiate and set the counter of our exact number of guesses to 0
+    if (dups)
+      r = r * symbols + p;
+    else
+    {
+      r = r * (symbols - (len - 1 - i)) + (p - __builtin_popcount(used & ((1u << p) - 1)));
+      used |= 1u << p;
+    }
+  }
+  return r;
+}
 
-  int exact = 0;
+static inline __attribute__((always_inline)) code_t unrankRules(uint64_t r, int colors, int len, int dups, int blanks)
+{
+  int low = blanks ? 0 : 1, symbols = colors + (blanks ? 1 : 0), digit[16];
+  unsigned int used = 0;
+  code_t c = 0;
 
-  // We instantiate and set the counter of our approximate number of guesses to 0
+  if (dups)
+  {
+    for (int i = 0; i < len; i++)
+    {
+      c |= (code_t)(r % symbols + low) << (4 * i);
+      r /= symbols;
+    }
+    return c;
+  }
 
-  int approximate = 0;
+  for (int i = 0; i < len; i++)
+  {
+    digit[i] = r % (symbols - (len - 1 - i));
+    r /= symbols - (len - 1 - i);
+  }
+  for (int i = len - 1; i >= 0; i--)
+  {
+    int p = 0;
 
-  // We malloc and initialize an array which we use to verify whether the element in-hand has already been checked or not
+    // We pick the digit[i]-th colour that is still unused.
 
-  int *checked = malloc(3 * sizeof(int));
+    for (int k = digit[i]; k > 0 || (used >> p) & 1; p++)
+      if (!((used >> p) & 1))
+        k--;
+    used |= 1u << p;
+    c |= (code_t)(p + low) << (4 * i);
+  }
+  return c;
+}
 
-  // As per our coursework specs, all our sequences will have only 3 elements. Therefore, the loop will also iterate
-  // only 3 times.
+/* step @c@ to the code of the next rank, in place; returns 0 (and leaves @c@ alone) if @c@ was the last one */
+static inline __attribute__((always_inline)) int nextRules(code_t *c, int colors, int len, int dups, int blanks)
+{
+  int low = blanks ? 0 : 1, high = colors;
+  code_t x = *c;
 
-  for (int i = 0; i < 3; i++)
+  if (dups)
   {
-    // If the element-in-hand of the user-entered sequence is equal to the corresponding element-in-hand of the
-    // system-generated squence, then this means that its an exact match. As both, the value as well as the position of
-    // the number is correct.
+    // An odometer: peg 0 moves fastest, and a peg at the highest colour wraps to the lowest and carries.
 
-    if (seq1[i] == seq2[i])
+    for (int i = 0; i < len; i++)
     {
-      // Therefore, we increment our exact counter variable by 1.
-      exact++;
+      if (PEG(x, i) < high)
+      {
+        *c = x + ((code_t)1 << (4 * i));
+        return 1;
+      }
+      x = (x & ~((code_t)0xF << (4 * i))) | ((code_t)low << (4 * i));
+    }
+    return 0;
+  }
 
-      // However, this element could have already been checked beforehand and be deemed as an approximate guess. So, we
-      // verify with our array checked to see whether or not the element-in-hand has already been accounted for.
+  // Without duplicates, peg i moves on to the next colour not used by the higher pegs, and the lower pegs restart
+  // from the smallest colours left.
 
-      // If yes:
+  for (int i = 0; i < len; i++)
+  {
+    unsigned int higher = 0;
 
-      if (checked[i])
+    for (int k = i + 1; k < len; k++)
+      higher |= 1u << PEG(x, k);
+    for (int p = PEG(x, i) + 1; p <= high; p++)
+      if (!((higher >> p) & 1))
       {
+        x = (x & ~((code_t)0xF << (4 * i))) | ((code_t)p << (4 * i));
+        higher |= 1u << p;
+        for (int k = i - 1; k >= 0; k--)
+        {
+          int q = low;
 
-        // We decrement the approximate guess counter by 1 as this is not an approximate guess, it is an exact one.
-
-        approximate--;
+          while ((higher >> q) & 1)
+            q++;
+          x = (x & ~((code_t)0xF << (4 * k))) | ((code_t)q << (4 * k));
+          higher |= 1u << q;
+        }
+        *c = x;
+        return 1;
       }
+  }
+  return 0;
+}
 
-      // We change the value of the corresponding element in the checked array to 1 so as to signify that the
-      // element-in-hand has been checked.
+static inline __attribute__((always_inline)) code_t genRules(unsigned int *seed, int colors, int len, int dups, int blanks)
+{
+  int low = blanks ? 0 : 1, symbols = colors + (blanks ? 1 : 0);
 
-      checked[i] = 1;
-    }
+  if (!dups)
+    return unrankRules(rand_r(seed) % sizeRules(colors, len, dups, blanks), colors, len, dups, blanks);
 
-    // If the sequence entered by the user is not exactly the same as the system-generated-sequence:
+  code_t c = 0;
 
-    else if (seq1[i] != seq2[i])
-    {
+  for (int i = 0; i < len; i++)
+    c |= (code_t)(rand_r(seed) % symbols + low) << (4 * i);
+  return c;
+}
 
-      // Another for loop is ran within the system-generated-sequence. This for loop is to check if the element-in-hand
-      // entered by the user exists somewhere in the system-generated-sequence if not in the exact location.
+/* instantiate the kernels of variant NAME */
+#define VARIANT_KERNELS(NAME, DUPS, BLANKS)                                                          \
+  static int score_##NAME(code_t secret, code_t guess, int len)                                       \
+  {                                                                                                   \
+    return scoreRules(secret, guess, len, DUPS, BLANKS);                                              \
+  }                                                                                                   \
+  static size_t filter_##NAME(code_t *codes, size_t n, code_t guess, int fb, int len)                 \
+  {                                                                                                   \
+    size_t kept = 0;                                                                                  \
+    for (size_t i = 0; i < n; i++)                                                                    \
+      if (scoreRules(codes[i], guess, len, DUPS, BLANKS) == fb)                                       \
+        codes[kept++] = codes[i];                                                                     \
+    return kept;                                                                                      \
+  }                                                                                                   \
+  static int partition_##NAME(const code_t *codes, size_t n, code_t guess, int len, unsigned int *part) \
+  {                                                                                                   \
+    unsigned int worst = 0;                                                                           \
+    for (size_t i = 0; i < n; i++)                                                                    \
+    {                                                                                                 \
+      unsigned int c = ++part[scoreRules(codes[i], guess, len, DUPS, BLANKS)];                        \
+      if (c > worst)                                                                                  \
+        worst = c;                                                                                    \
+    }                                                                                                 \
+    return (int)worst;                                                                                \
+  }                                                                                                   \
+  static int classify_##NAME(const code_t *codes, size_t n, code_t guess, int len, uint8_t *cls,      \
+                             unsigned int *part)                                                      \
+  {                                                                                                   \
+    unsigned int worst = 0;                                                                           \
+    for (size_t i = 0; i < n; i++)                                                                    \
+    {                                                                                                 \
+      int fb = scoreRules(codes[i], guess, len, DUPS, BLANKS);                                        \
+      unsigned int c = ++part[fb];                                                                    \
+      cls[i] = (uint8_t)fb;                                                                           \
+      if (c > worst)                                                                                  \
+        worst = c;                                                                                    \
+    }                                                                                                 \
+    return (int)worst;                                                                                \
+  }                                                                                                   \
+  static code_t gen_##NAME(unsigned int *seed, int colors, int len)                                   \
+  {                                                                                                   \
+    return genRules(seed, colors, len, DUPS, BLANKS);                                                 \
+  }                                                                                                   \
+  static uint64_t size_##NAME(int colors, int len)                                                    \
+  {                                                                                                   \
+    return sizeRules(colors, len, DUPS, BLANKS);                                                      \
+  }                                                                                                   \
+  static uint64_t rank_##NAME(code_t c, int colors, int len)                                          \
+  {                                                                                                   \
+    return rankRules(c, colors, len, DUPS, BLANKS);                                                   \
+  }                                                                                                   \
+  static code_t unrank_##NAME(uint64_t r, int colors, int len)                                        \
+  {                                                                                                   \
+    return unrankRules(r, colors, len, DUPS, BLANKS);                                                 \
+  }                                                                                                   \
+  static int next_##NAME(code_t *c, int colors, int len)                                              \
+  {                                                                                                   \
+    return nextRules(c, colors, len, DUPS, BLANKS);                                                   \
+  }
 
-      for (int j = 0; j < 3; j++)
-      {
-        if (seq1[j] == seq2[i])
-        {
+#define VARIANT_ENTRY(NAME, DUPS, BLANKS) \
+  {#NAME, DUPS, BLANKS, score_##NAME, filter_##NAME, partition_##NAME, classify_##NAME, gen_##NAME, size_##NAME, rank_##NAME, unrank_##NAME, next_##NAME},
 
-          // If it does exist elsewhere in the system-generated-sequence, then we increment the approximate counter by 1
-          // as the value is correct but the position is wrong. We also insert 1 into the corresponding element in our
-          // list checked so as to signify that the element-in-hand has been checked.
+VARIANTS(VARIANT_KERNELS)
 
-          if (!checked[j])
-          {
-            approximate++;
-            checked[j] = 1;
+static const struct variant variants[] = {VARIANTS(VARIANT_ENTRY)};
 
-            // We break so that it repeats the same process for the next element in the user-entered list and so on and
-            // so forth.
+/* the rules the game is played by (-V) */
+static const struct variant *gameVariant = &variants[0];
 
-            break;
-          }
-        }
-      }
+/* look up a variant by name; NULL if there is none */
+const struct variant *findVariant(const char *name)
+{
+  for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++)
+    if (strcmp(variants[i].name, name) == 0)
+      return &variants[i];
+  return NULL;
+}
+
+/* ======================================================= */
+/* SECTION: game logic                                     */
+/* ------------------------------------------------------- */
+/* AUX fcts of the game logic */
+
+
+/* the next secret, generated in the background while the current game is being played (see -g) */
+static int *nextSeq = NULL;
+static int nextSeqReady = 0, seqPrefetchRunning = 0, seqPrefetchStop = 0;
+static pthread_t seqPrefetchThread;
+static pthread_mutex_t seqPrefetchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t seqPrefetchCond = PTHREAD_COND_INITIALIZER;
+
+/* fill @seq@ with a random sequence allowed by the rules of the game, using the re-entrant generator state @seed@ */
+static void randomSeq(int *seq, unsigned int *seed)
+{
+  unpackSeq(gameVariant->gen(seed, colors, seqlen), seq, seqlen);
+}
+
+/* background thread: keeps exactly one fresh secret ready in nextSeq */
+static void *seqPrefetchLoop(void *arg)
+{
+  unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+
+  (void)arg;
+
+  pthread_mutex_lock(&seqPrefetchLock);
+  while (!seqPrefetchStop)
+  {
+    if (!nextSeqReady)
+    {
+      randomSeq(nextSeq, &seed);
+      nextSeqReady = 1;
+      pthread_cond_broadcast(&seqPrefetchCond);
     }
+    pthread_cond_wait(&seqPrefetchCond, &seqPrefetchLock);
+  }
+  pthread_mutex_unlock(&seqPrefetchLock);
+  return NULL;
+}
+
+void startSeqPrefetch(void)
+{
+  nextSeq = (int *)malloc(seqlen * sizeof(int));
+  if (pthread_create(&seqPrefetchThread, NULL, seqPrefetchLoop, NULL) == 0)
+    seqPrefetchRunning = 1;
+}
+
+void stopSeqPrefetch(void)
+{
+  if (!seqPrefetchRunning)
+    return;
+  pthread_mutex_lock(&seqPrefetchLock);
+  seqPrefetchStop = 1;
+  pthread_cond_broadcast(&seqPrefetchCond);
+  pthread_mutex_unlock(&seqPrefetchLock);
+  pthread_join(seqPrefetchThread, NULL);
+  seqPrefetchRunning = 0;
+}
+
+/* fill @seq@ with a new random secret: the one prepared in the background if the prefetch thread runs */
+void drawSeq(int *seq)
+{
+  static unsigned int seed = 0;
+
+  // If the prefetch thread is running, a secret is already waiting for us: we take it and let the thread prepare the
+  // next one while this game is played.
+
+  if (seqPrefetchRunning)
+  {
+    pthread_mutex_lock(&seqPrefetchLock);
+    while (!nextSeqReady)
+      pthread_cond_wait(&seqPrefetchCond, &seqPrefetchLock);
+    memcpy(seq, nextSeq, seqlen * sizeof(int));
+    nextSeqReady = 0;
+    pthread_cond_broadcast(&seqPrefetchCond);
+    pthread_mutex_unlock(&seqPrefetchLock);
+    return;
   }
 
+  // Otherwise we seed the random number generator with the time (once per process) and generate the sequence here.
+  // As per our coursework specs, the randomly generated numbers will range between only 1 to 3 (0 is a blank, if the
+  // variant allows blanks).
+
+  if (seed == 0)
+    seed = (unsigned int)time(NULL);
+  randomSeq(seq, &seed);
+}
+
+/* initialise the secret sequence; by default it should be a random sequence */
+void initSeq()
+{
+  // We malloc our array theSeq only once; later calls overwrite it in place.
+
+  if (theSeq == NULL)
+    theSeq = (int *)malloc(seqlen * sizeof(int));
+  drawSeq(theSeq);
+}
+
+/* display the sequence on the terminal window, using the format from the sample run in the spec */
+void showSeq(int *seq)
+{
+  logMsg(LOG_OUT, stdout, "The secret sequence is:");
+  for (int i = 0; i < seqlen; i++)
+    logMsg(LOG_OUT, stdout, " %d", seq[i]);
+  logMsg(LOG_OUT, stdout, "\n");
+}
+
+#define NAN1 8
+#define NAN2 9
+
+/* counts how many entries in seq2 match entries in seq1 */
+/* returns exact and approximate matches, either both encoded in one value, */
+/* or as a pointer to a pair of values */
+int /* or int* */ countMatches(int *seq1, int *seq2)
+{
+  // The rules of the variant selected with -V decide how a guess is scored, so we hand both sequences over to that
+  // variant's specialised kernel, packed into codes.
+
+  int fb = gameVariant->score(packSeq(seq1, seqlen), packSeq(seq2, seqlen), seqlen);
+
   // When returning, we return it as a single number with the exact number of matches at the ten's place and the
   // approximate number of matches at the one's.
 
-  matchesFound = (exact * 10) + approximate;
-  return matchesFound;
+  return (FB_EXACT(fb) * 10) + FB_APPROX(fb);
 }
 
 /* show the results from calling countMatches on seq1 and seq1 */
@@ -467,8 +872,8 @@ void showMatches(int  code,  int *seq1, int *seq2,  int lcd_format)
   int approxMatch = code % 10;
 
   // Then we print onto terminal the number of exact and approximate matches.
-  printf("%d exact\n", exactMatch);
-  printf("%d approximate\n", approxMatch);
+  logMsg(LOG_OUT, stdout, "%d exact\n", exactMatch);
+  logMsg(LOG_OUT, stdout, "%d approximate\n", approxMatch);
 }
 
 /* parse an integer value as a list of digits, and put them into @seq@ */
@@ -485,9 +890,9 @@ void readSeq(int *seq, int val)
 
   int j = val;
 
-  // Our specs demand only 3 inputs, there the number of elements present in the array will always be 3.
+  // Our specs demand only 3 inputs, but with -L the sequence can be longer or shorter: there is one digit per peg.
 
-  for (int i = 2; i >= 0; i--)
+  for (int i = seqlen - 1; i >= 0; i--)
   {
 
     // We assign each element in the array to the corresponding digit starting from the one's place to the hundred's
@@ -579,6 +984,7 @@ int failure(int fatal, const char *message, ...)
 
 void waitForEnter(void)
 {
+  logSync();
   printf("Press ENTER to continue: ");
   (void)fgetc(stdin);
 }
@@ -600,126 +1006,4064 @@ void delay(unsigned int howLong)
 }
 
 
+/* delays up to this many us are busy-waited on the system timer; nanosleep overshoots by roughly this much */
+static unsigned int delaySpinThreshold = 100;
+
+/* read the 64-bit free-running system timer (CHI:CLO), in us; falls back to the monotonic clock if not mapped */
+uint64_t piTimeNow(void)
+{
+  uint32_t hi, lo;
+
+  if (piTime == NULL)
+  {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)(now.tv_nsec / 1000);
+  }
+
+  // CLO (word 1) wraps about every 71 minutes into CHI (word 2). We read CHI before and after CLO and retry if it moved,
+  // so the two halves always belong together.
+
+  do
+  {
+    hi = *(piTime + 2);
+    lo = *(piTime + 1);
+  } while (hi != *(piTime + 2));
+
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/* busy-wait for @howLong@ us on the system timer */
+void delayMicrosecondsHard(unsigned int howLong)
+{
+  uint64_t end = piTimeNow() + howLong;
+
+  while (piTimeNow() < end)
+    ;
+}
+
+/* measure how far nanosleep overshoots on this machine, and use that as the spin threshold for delayMicroseconds */
+void calibrateDelay(void)
+{
+  enum { ROUNDS = 16 };
+  unsigned int over[ROUNDS], t;
+  struct timespec sleeper = {0, 1000};
+
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    uint64_t start = piTimeNow();
+
+    nanosleep(&sleeper, NULL);
+    over[i] = (unsigned int)(piTimeNow() - start);
+  }
+
+  // We sort the (few) samples and take the 90th percentile, so that one unlucky preemption does not make every short
+  // delay spin.
+
+  for (int i = 1; i < ROUNDS; i++)
+    for (int j = i; j > 0 && over[j - 1] > over[j]; j--)
+    {
+      t = over[j];
+      over[j] = over[j - 1];
+      over[j - 1] = t;
+    }
+  delaySpinThreshold = over[(ROUNDS * 9) / 10];
+}
+
 void delayMicroseconds(unsigned int howLong)
 {
   struct timespec sleeper;
-  unsigned int uSecs = howLong % 1000000;
-  unsigned int wSecs = howLong / 1000000;
+  uint64_t end;
+  unsigned int sleepFor;
 
   /**/ if (howLong == 0)
     return;
-#if 0
-  else if (howLong  < 100)
+  else if (howLong <= delaySpinThreshold)
     delayMicrosecondsHard (howLong) ;
-#endif
   else
   {
-    sleeper.tv_sec = wSecs;
-    sleeper.tv_nsec = (long)(uSecs * 1000L);
+    // We sleep for all but the expected overshoot, and spin on the timer for the rest, so that we neither oversleep
+    // nor burn the CPU for long delays.
+
+    end = piTimeNow() + howLong;
+    sleepFor = howLong - delaySpinThreshold;
+    sleeper.tv_sec = sleepFor / 1000000;
+    sleeper.tv_nsec = (long)((sleepFor % 1000000) * 1000L);
     nanosleep(&sleeper, NULL);
+    while (piTimeNow() < end)
+      ;
   }
 }
 
 /* ======================================================= */
-/* SECTION: aux functions for game logic                   */
+/* SECTION: real-time execution (-R)                       */
 /* ------------------------------------------------------- */
+/* lock memory, pin the sampling thread to one core, run it under SCHED_FIFO, and keep track of the sampling jitter */
 
-/* interface on top of the low-level pin I/O code */
+/* histogram of sampling intervals (in us, measured on piTime) */
+static uint64_t jitterHist[JITTER_BUCKETS];
+static uint64_t jitterSamples = 0, jitterMax = 0;
+static uint64_t jitterLast = 0;
+static int jitterHaveLast = 0;
 
-/* blink the led on pin @led@, @c@ times */
-void blinkN(uint32_t *gpio, int led, int c)
+/* put the calling (sampling) thread into real-time mode; @cpu@ < 0 picks the last online core */
+int enterRealTime(int cpu)
 {
+  struct sched_param param;
+  cpu_set_t set;
+  int err, ok = 1;
 
-  // This method is responsible for blinking either of the leds (red or green) depending on the argument passed (the
-  // corresponding argument is int led) for n number of times based on the argument passed (the corresponding argument is
-  // int c).
-
-  // For instance, if we want to make the red LED blink twice, we'd call this method as blinkN(gpio, 5, 2) as 5 is the PIN
-  // number of the red LED and 2 as we want it to blink twice.
+  // We lock all current and future pages, so that no page fault can delay the sampling loop.
 
-  for (int i = 0; i < c; i++)
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
   {
+    fprintf(stderr, "realtime: mlockall failed: %s\n", strerror(errno));
+    ok = 0;
+  }
 
-    // We turn the LED on by setting our desired PIN to HIGH using our writeLED method.
-
-    writeLED(gpio, led, HIGH);
-
-    // We've added some delay before the next blink to avoid it from blinking too fast and to execute our program flow
-    // at a healthy pace.
+  // Isolated cores (isolcpus=...) are by convention the last ones, so that is our default.
 
-    {
-      struct timespec sleeper, dummy;
+  if (cpu < 0)
+    cpu = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if ((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+  {
+    fprintf(stderr, "realtime: cannot pin to CPU %d: %s\n", cpu, strerror(err));
+    ok = 0;
+  }
 
-      sleeper.tv_sec = (time_t)(200 / 1000);
-      sleeper.tv_nsec = (long)(200 % 1000) * 1000000;
+  param.sched_priority = RT_PRIORITY;
+  if ((err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0)
+  {
+    fprintf(stderr, "realtime: cannot switch to SCHED_FIFO: %s\n", strerror(err));
+    ok = 0;
+  }
 
-      nanosleep(&sleeper, &dummy);
-    }
+  return ok ? 0 : -1;
+}
 
-    // We turn the LED off by setting our desired PIN to LOW using our writeLED method.
+/* record one sample of the polling loop, taken at timer value @now@ */
+static inline void jitterSample(uint64_t now)
+{
+  uint64_t delta;
 
-    writeLED(gpio, led, LOW);
+  if (jitterHaveLast)
+  {
+    delta = now - jitterLast;
+    jitterHist[delta < JITTER_BUCKETS ? delta : JITTER_BUCKETS - 1]++;
+    if (delta > jitterMax)
+      jitterMax = delta;
+    jitterSamples++;
+  }
+  jitterLast = now;
+  jitterHaveLast = 1;
+}
 
-    // We've added some delay before the next blink to avoid it from blinking too fast and to execute our program flow
-    // at a healthy pace.
+/* the sampling interval (in us) below which @permille@ of all samples lie */
+static uint64_t jitterPercentile(int permille)
+{
+  uint64_t want = (jitterSamples * permille + 999) / 1000, seen = 0;
 
-    {
-      struct timespec sleeper, dummy;
+  for (int i = 0; i < JITTER_BUCKETS; i++)
+  {
+    seen += jitterHist[i];
+    if (seen >= want)
+      return i;
+  }
+  return jitterMax;
+}
 
-      sleeper.tv_sec = (time_t)(200 / 1000);
-      sleeper.tv_nsec = (long)(200 % 1000) * 1000000;
+/* print the jitter statistics; registered with atexit() in real-time mode */
+void reportJitter(void)
+{
+  uint64_t p50;
 
-      nanosleep(&sleeper, &dummy);
-    }
-    // This proccess ensues until the method has finished iterating completely.
+  if (jitterSamples == 0)
+  {
+    fprintf(stderr, "realtime: no samples taken\n");
+    return;
   }
+  p50 = jitterPercentile(500);
+  fprintf(stderr, "realtime: %llu samples; interval p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+          (unsigned long long)jitterSamples, (unsigned long long)p50, (unsigned long long)jitterPercentile(990),
+          (unsigned long long)jitterPercentile(999), (unsigned long long)jitterMax);
+  fprintf(stderr, "realtime: jitter (vs. p50) p99 %llu us, p99.9 %llu us, max %llu us\n",
+          (unsigned long long)(jitterPercentile(990) - p50), (unsigned long long)(jitterPercentile(999) - p50),
+          (unsigned long long)(jitterMax - p50));
 }
 
 /* ======================================================= */
-/* SECTION: main fct                                       */
+/* SECTION: asynchronous logging                           */
 /* ------------------------------------------------------- */
+/* every thread that logs gets its own single-producer/single-consumer ring; one writer thread formats and writes */
+/* the records, so a slow terminal never stalls the caller. A record only holds the format pointer and the raw     */
+/* arguments, which means formats must be string literals and %s arguments must outlive the record (static data). */
 
-int main(int argc, char *argv[])
-{ // this is just a suggestion of some variable that you may want to use
-  int bits, rows, cols;
-  unsigned char func;
+typedef union
+{
+  long long i;
+  unsigned long long u;
+  double d;
+  long double ld;
+  const char *s;
+  void *p;
+} logArg;
+
+struct logRecord
+{
+  const char *fmt;
+  FILE *out;
+  logArg args[LOG_MAX_ARGS];
+};
 
-  int found = 0, attempts = 0, i, j, code;
-  int c, d, buttonPressed, rel, foo;
-  int *attSeq;
+struct logRing
+{
+  volatile unsigned int head; // next record to write out; only moved by the writer thread
+  volatile unsigned int tail; // next free slot; only moved by the producer
+  unsigned long dropped;
+  struct logRecord rec[LOG_RING_SIZE];
+};
 
-  int pinLED = LED, pin2LED2 = LED2, pinButton = BUTTON;
-  int fSel, shift, pin, clrOff, setOff, off, res;
-  int fd;
+static struct logRing *logRings[LOG_MAX_PRODUCERS];
+static int logNumRings = 0;
+static __thread struct logRing *logMyRing = NULL;
 
-  int exact, contained;
-  char str1[32];
-  char str2[32];
+static int logLevel = LOG_OUT;
+static volatile int logRunning = 0, logStop = 0;
+static pthread_t logThread;
 
-  struct timeval t1, t2;
-  int t;
+/* walk one conversion spec of a printf format starting after the '%' at @f@; returns a pointer to the conversion  */
+/* character, and sets @kind@ to 'i' (signed), 'u' (unsigned), 'd' (double), 's' (string), 'p' (pointer), '%' or 0 */
+/* and @size@ to the length modifier (see LOG_SIZE_*), @star@ to the number of '*' (int) arguments in the spec      */
+enum
+{
+  LOG_SIZE_INT,  // none (or h, hh: promoted to int)
+  LOG_SIZE_LONG, // l
+  LOG_SIZE_LL,   // ll
+  LOG_SIZE_Z,    // z: size_t/ssize_t
+  LOG_SIZE_J,    // j: intmax_t/uintmax_t
+  LOG_SIZE_LD    // L: long double
+};
 
-  char buf[32];
+static const char *logSpec(const char *f, char *kind, int *size, int *star)
+{
+  *size = LOG_SIZE_INT;
+  *star = 0;
+  while (*f && strchr("-+ #0", *f))
+    f++;
+  while (*f == '*' || (*f >= '0' && *f <= '9') || *f == '.')
+    if (*f++ == '*')
+      (*star)++;
+  for (; *f && strchr("hlzjL", *f); f++)
+    switch (*f)
+    {
+    case 'l':
+      *size = *size == LOG_SIZE_LONG ? LOG_SIZE_LL : LOG_SIZE_LONG;
+      break;
+    case 'z':
+      *size = LOG_SIZE_Z;
+      break;
+    case 'j':
+      *size = LOG_SIZE_J;
+      break;
+    case 'L':
+      *size = LOG_SIZE_LD;
+      break;
+    }
 
-  // variables for command-line processing
-  char str_in[20], str[20] = "some text";
-  int verbose = 0, debug = 0, help = 0, opt_m = 0, opt_n = 0, opt_s = 0, unit_test = 0, res_matches = 0;
+  switch (*f)
+  {
+  case 'd': case 'i': case 'c':
+    *kind = 'i';
+    break;
+  case 'u': case 'x': case 'X': case 'o':
+    *kind = 'u';
+    break;
+  case 'f': case 'e': case 'g': case 'E': case 'G':
+    *kind = 'd';
+    break;
+  case 's':
+    *kind = 's';
+    break;
+  case 'p':
+    *kind = 'p';
+    break;
+  case '%':
+    *kind = '%';
+    break;
+  default:
+    *kind = 0;
+  }
+  return f;
+}
 
-  // -------------------------------------------------------
-  // process command-line arguments
+/* log a message; @level@ is filtered against -v/-d, and without a running writer thread the message is printed   */
+/* synchronously. Only the format pointer and the arguments are copied here; formatting happens in the writer, so  */
+/* @fmt@ and every %s argument must stay valid (and unchanged) until the record is written: use string literals    */
+/* and static data, never a local buffer.                                                                          */
+void logMsg(int level, FILE *out, const char *fmt, ...)
+{
+  struct logRing *ring = logMyRing;
+  struct logRecord *rec;
+  unsigned int tail;
+  const char *f;
+  va_list ap;
+  int n = 0, size, star;
+  char kind;
+
+  if (level > logLevel)
+    return;
 
-  // see: man 3 getopt for docu and an example of command line parsing
-  { 
-    int opt;
-    while ((opt = getopt(argc, argv, "hvdus:")) != -1)
+  if (!logRunning)
+  {
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+    return;
+  }
+
+  // The first message of a thread registers a fresh ring for it; if all slots are taken we print synchronously.
+
+  if (ring == NULL)
+  {
+    int slot = __atomic_fetch_add(&logNumRings, 1, __ATOMIC_ACQ_REL);
+
+    if (slot >= LOG_MAX_PRODUCERS)
     {
-      switch (opt)
-      {
-      case 'v':
-        verbose = 1;
-        break;
-      case 'h':
-        help = 1;
+      va_start(ap, fmt);
+      vfprintf(out, fmt, ap);
+      va_end(ap);
+      return;
+    }
+    ring = (struct logRing *)calloc(1, sizeof(struct logRing));
+    __atomic_store_n(&logRings[slot], ring, __ATOMIC_RELEASE);
+    logMyRing = ring;
+  }
+
+  tail = ring->tail;
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == LOG_RING_SIZE)
+  {
+    ring->dropped++;
+    return;
+  }
+
+  rec = &ring->rec[tail & (LOG_RING_SIZE - 1)];
+  rec->fmt = fmt;
+  rec->out = out;
+
+  // We copy the arguments with the types the format asks for, so the writer can hand them back to printf unchanged.
+
+  va_start(ap, fmt);
+  for (f = strchr(fmt, '%'); f != NULL && n < LOG_MAX_ARGS; f = strchr(f + 1, '%'))
+  {
+    f = logSpec(f + 1, &kind, &size, &star);
+    while (star-- > 0 && n < LOG_MAX_ARGS)
+      rec->args[n++].i = va_arg(ap, int);
+    if (n >= LOG_MAX_ARGS)
+      break;
+    switch (kind)
+    {
+    case 'i':
+      rec->args[n++].i = size == LOG_SIZE_INT    ? va_arg(ap, int)
+                         : size == LOG_SIZE_LONG ? va_arg(ap, long)
+                         : size == LOG_SIZE_LL   ? va_arg(ap, long long)
+                         : size == LOG_SIZE_Z    ? va_arg(ap, ssize_t)
+                                                 : va_arg(ap, intmax_t);
+      break;
+    case 'u':
+      rec->args[n++].u = size == LOG_SIZE_INT    ? va_arg(ap, unsigned int)
+                         : size == LOG_SIZE_LONG ? va_arg(ap, unsigned long)
+                         : size == LOG_SIZE_LL   ? va_arg(ap, unsigned long long)
+                         : size == LOG_SIZE_Z    ? va_arg(ap, size_t)
+                                                 : va_arg(ap, uintmax_t);
+      break;
+    case 'd':
+      if (size == LOG_SIZE_LD)
+        rec->args[n++].ld = va_arg(ap, long double);
+      else
+        rec->args[n++].d = va_arg(ap, double);
+      break;
+    case 's':
+      rec->args[n++].s = va_arg(ap, const char *);
+      break;
+    case 'p':
+      rec->args[n++].p = va_arg(ap, void *);
+      break;
+    default:
+      break;
+    }
+  }
+  va_end(ap);
+
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* format one record, conversion by conversion, and write it to its stream */
+static void logWrite(struct logRecord *rec)
+{
+  char piece[64], line[512];
+  const char *f = rec->fmt, *spec;
+  int n = 0, len = 0, size, star, w;
+  char kind;
+
+  while (*f && len < (int)sizeof(line) - 1)
+  {
+    if (*f != '%')
+    {
+      line[len++] = *f++;
+      continue;
+    }
+    spec = f;
+    f = logSpec(f + 1, &kind, &size, &star) + 1;
+    if (kind == '%')
+    {
+      line[len++] = '%';
+      continue;
+    }
+    if (kind == 0)
+      continue;
+    if (star > 0 || f - spec >= (int)sizeof(piece) || n >= LOG_MAX_ARGS)
+    {
+      n += star + 1; // '*' widths are not supported on the fast path; we skip the arguments
+      continue;
+    }
+
+    memcpy(piece, spec, f - spec);
+    piece[f - spec] = '\0';
+    switch (kind)
+    {
+    case 'i':
+      w = size == LOG_SIZE_INT  ? snprintf(line + len, sizeof(line) - len, piece, (int)rec->args[n].i)
+        : size == LOG_SIZE_LONG ? snprintf(line + len, sizeof(line) - len, piece, (long)rec->args[n].i)
+        : size == LOG_SIZE_LL   ? snprintf(line + len, sizeof(line) - len, piece, rec->args[n].i)
+        : size == LOG_SIZE_Z    ? snprintf(line + len, sizeof(line) - len, piece, (ssize_t)rec->args[n].i)
+                                : snprintf(line + len, sizeof(line) - len, piece, (intmax_t)rec->args[n].i);
+      break;
+    case 'u':
+      w = size == LOG_SIZE_INT  ? snprintf(line + len, sizeof(line) - len, piece, (unsigned int)rec->args[n].u)
+        : size == LOG_SIZE_LONG ? snprintf(line + len, sizeof(line) - len, piece, (unsigned long)rec->args[n].u)
+        : size == LOG_SIZE_LL   ? snprintf(line + len, sizeof(line) - len, piece, rec->args[n].u)
+        : size == LOG_SIZE_Z    ? snprintf(line + len, sizeof(line) - len, piece, (size_t)rec->args[n].u)
+                                : snprintf(line + len, sizeof(line) - len, piece, (uintmax_t)rec->args[n].u);
+      break;
+    case 'd':
+      w = size == LOG_SIZE_LD ? snprintf(line + len, sizeof(line) - len, piece, rec->args[n].ld)
+                              : snprintf(line + len, sizeof(line) - len, piece, rec->args[n].d);
+      break;
+    case 's':
+      w = snprintf(line + len, sizeof(line) - len, piece, rec->args[n].s);
+      break;
+    default:
+      w = snprintf(line + len, sizeof(line) - len, piece, rec->args[n].p);
+      break;
+    }
+    n++;
+    len += w;
+    if (len > (int)sizeof(line) - 1)
+      len = sizeof(line) - 1;
+  }
+  fwrite(line, 1, len, rec->out);
+}
+
+/* drain all rings once; returns the number of records written */
+static int logDrain(void)
+{
+  int written = 0, rings = __atomic_load_n(&logNumRings, __ATOMIC_ACQUIRE);
+
+  if (rings > LOG_MAX_PRODUCERS)
+    rings = LOG_MAX_PRODUCERS;
+  for (int r = 0; r < rings; r++)
+  {
+    struct logRing *ring = __atomic_load_n(&logRings[r], __ATOMIC_ACQUIRE);
+    unsigned int head, tail;
+
+    if (ring == NULL)
+      continue;
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++, written++)
+    {
+      logWrite(&ring->rec[head & (LOG_RING_SIZE - 1)]);
+      __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+  }
+  if (written)
+  {
+    fflush(stdout);
+    fflush(stderr);
+  }
+  return written;
+}
+
+static void *logLoop(void *arg)
+{
+  struct timespec idle = {0, LOG_IDLE_SLEEP * 1000L};
+
+  (void)arg;
+
+  while (!logStop)
+    if (logDrain() == 0)
+      nanosleep(&idle, NULL);
+  logDrain();
+  return NULL;
+}
+
+/* start the writer thread; from now on logMsg() only queues messages. logShutdown() is also registered with       */
+/* atexit(), so that queued messages are written whichever way the process ends normally.                          */
+void logStart(int verbose, int debug)
+{
+  logLevel = debug ? LOG_DEBUG : verbose ? LOG_VERBOSE : LOG_OUT;
+  if (pthread_create(&logThread, NULL, logLoop, NULL) == 0)
+  {
+    logRunning = 1;
+    atexit(logShutdown);
+  }
+}
+
+/* wait until everything logged so far has been written, e.g. before prompting on the terminal */
+void logSync(void)
+{
+  struct timespec idle = {0, LOG_IDLE_SLEEP * 1000L};
+  int busy = logRunning;
+
+  while (busy)
+  {
+    busy = 0;
+    for (int r = 0; r < LOG_MAX_PRODUCERS && r < __atomic_load_n(&logNumRings, __ATOMIC_ACQUIRE); r++)
+    {
+      struct logRing *ring = __atomic_load_n(&logRings[r], __ATOMIC_ACQUIRE);
+
+      if (ring != NULL && __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail)
+        busy = 1;
+    }
+    if (busy)
+      nanosleep(&idle, NULL);
+  }
+}
+
+/* write out what is left, stop the writer thread and report lost messages */
+void logShutdown(void)
+{
+  unsigned long dropped = 0;
+
+  if (!logRunning)
+    return;
+  logStop = 1;
+  pthread_join(logThread, NULL);
+  logRunning = 0;
+  for (int r = 0; r < LOG_MAX_PRODUCERS && r < logNumRings; r++)
+    if (logRings[r] != NULL)
+      dropped += logRings[r]->dropped;
+  if (dropped)
+    fprintf(stderr, "log: %lu messages dropped (ring full)\n", dropped);
+}
+
+/* ======================================================= */
+/* SECTION: button sampling thread                         */
+/* ------------------------------------------------------- */
+/* a dedicated thread samples the level register at a fixed rate, debounces every button, and publishes press  */
+/* and release events, stamped with the time of the first edge, through a lock-free single-producer/single-     */
+/* consumer ring. samplerStep() is one sample and does not care where the register and the time come from, so  */
+/* the debouncer can be driven by a simulated register block as well (see -T debounce).                         */
+
+struct buttonEvent
+{
+  uint64_t time; // when the level first changed, in us
+  int button;    // index of the button in the sampler
+  int press;     // 1 for a press, 0 for a release
+};
+
+struct eventRing
+{
+  volatile unsigned int head, tail;
+  unsigned long dropped;
+  struct buttonEvent ev[EVENT_RING_SIZE];
+};
+
+/* debounce state of one button: the accepted level, the level it may be changing to since @since@, and (while */
+/* it bounces) the time of the first edge, which is what the event will carry                                  */
+struct debounce
+{
+  int stable, changing, pending;
+  uint64_t since, edgeAt, back;
+};
+
+struct sampler
+{
+  volatile uint32_t *reg;  // level register (GPLEV0, or a simulated one)
+  uint32_t period;         // time between samples, in us
+  uint32_t settle;         // how long a new level must hold before it is accepted, in us
+  int buttons, pin[MAX_STATIONS];
+  struct debounce db[MAX_STATIONS];
+  struct eventRing ring;
+  int realtime, cpu;
+  volatile int stop;
+  pthread_t thread;
+};
+
+static struct sampler buttonSampler;
+
+void samplerInit(struct sampler *s, volatile uint32_t *reg, uint32_t period, uint32_t settle)
+{
+  memset(s, 0, sizeof(*s));
+  s->reg = reg;
+  s->period = period;
+  s->settle = settle;
+}
+
+/* add the button on @pin@; returns its index, which is what its events carry */
+int samplerAdd(struct sampler *s, int pin)
+{
+  s->pin[s->buttons] = pin;
+  return s->buttons++;
+}
+
+static void eventPush(struct eventRing *r, uint64_t time, int button, int press)
+{
+  unsigned int tail = r->tail;
+
+  if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == EVENT_RING_SIZE)
+  {
+    r->dropped++;
+    return;
+  }
+  r->ev[tail & (EVENT_RING_SIZE - 1)].time = time;
+  r->ev[tail & (EVENT_RING_SIZE - 1)].button = button;
+  r->ev[tail & (EVENT_RING_SIZE - 1)].press = press;
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* take the oldest event off the ring; returns 0 if there is none */
+int eventPop(struct eventRing *r, struct buttonEvent *ev)
+{
+  unsigned int head = r->head;
+
+  if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+    return 0;
+  *ev = r->ev[head & (EVENT_RING_SIZE - 1)];
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* take one sample at time @now@: one read of the level register for all buttons */
+void samplerStep(struct sampler *s, uint64_t now)
+{
+  uint32_t levels = *s->reg;
+
+  for (int b = 0; b < s->buttons; b++)
+  {
+    struct debounce *d = &s->db[b];
+    int level = (levels >> s->pin[b]) & 1;
+
+    // A level different from the accepted one starts (or continues) a change; going back cancels it. Only once the
+    // new level has held for @settle@ us do we accept it and report the edge, with the time of the first edge of the
+    // bounce. A change that falls back and stays back for @settle@ us was noise, and is forgotten.
+
+    if (level == d->stable)
+    {
+      if (d->changing)
+      {
+        d->changing = 0;
+        d->back = now;
+      }
+      else if (d->pending && now - d->back >= s->settle)
+        d->pending = 0;
+      continue;
+    }
+    if (!d->pending)
+    {
+      d->pending = 1;
+      d->edgeAt = now;
+    }
+    if (!d->changing)
+    {
+      d->changing = 1;
+      d->since = now;
+    }
+    else if (now - d->since >= s->settle)
+    {
+      d->stable = level;
+      d->changing = d->pending = 0;
+      eventPush(&s->ring, d->edgeAt, b, level);
+    }
+  }
+}
+
+static void *samplerLoop(void *arg)
+{
+  struct sampler *s = (struct sampler *)arg;
+  uint64_t next, now;
+
+  if (s->realtime)
+    enterRealTime(s->cpu);
+
+  // We sample against absolute deadlines on the system timer, so that the rate does not drift with the work done.
+
+  next = piTimeNow();
+  while (!s->stop)
+  {
+    now = piTimeNow();
+    jitterSample(now);
+    samplerStep(s, now);
+    next += s->period;
+    now = piTimeNow();
+    if (next > now)
+      delayMicroseconds((unsigned int)(next - now));
+    else
+      next = now; // we fell behind; catch up rather than sampling in a burst
+  }
+  return NULL;
+}
+
+int samplerStart(struct sampler *s, int realtime, int cpu)
+{
+  s->realtime = realtime;
+  s->cpu = cpu;
+  return pthread_create(&s->thread, NULL, samplerLoop, s);
+}
+
+void samplerStop(struct sampler *s)
+{
+  s->stop = 1;
+  pthread_join(s->thread, NULL);
+  if (s->ring.dropped)
+    logMsg(LOG_OUT, stderr, "sampler: %lu button events dropped (ring full)\n", s->ring.dropped);
+}
+
+/* ------------------------------------------------------- */
+/* self-test: scripted bounce patterns on a simulated register block */
+
+/* one piece of a script: from @at@ us on, the button reads @level@ */
+struct levelScript
+{
+  uint64_t at;
+  int level;
+};
+
+/* run @script@ (@n@ pieces, ending at @end@ us) through a sampler on a simulated register; returns the number */
+/* of presses and releases reported, and checks that each press is stamped within @slack@ us of @pressAt@       */
+static int runScript(const struct levelScript *script, int n, uint64_t end, const uint64_t *pressAt, int *presses,
+                     int *releases, int *late)
+{
+  struct sampler s;
+  struct buttonEvent ev;
+  uint32_t simReg = 0;
+  int piece = 0;
+
+  samplerInit(&s, &simReg, SAMPLE_PERIOD, DEBOUNCE_TIME);
+  samplerAdd(&s, BUTTON);
+  *presses = *releases = *late = 0;
+  for (uint64_t t = 0; t < end; t += SAMPLE_PERIOD)
+  {
+    while (piece < n && script[piece].at <= t)
+      simReg = script[piece++].level ? (1u << BUTTON) : 0;
+    samplerStep(&s, t);
+    while (eventPop(&s.ring, &ev))
+    {
+      if (ev.press)
+      {
+        if (pressAt && (ev.time < pressAt[*presses] || ev.time > pressAt[*presses] + SAMPLE_PERIOD))
+          (*late)++;
+        (*presses)++;
+      }
+      else
+        (*releases)++;
+    }
+  }
+  return 0;
+}
+
+/* the debouncer against a few typical button behaviours; returns the number of failed cases */
+int selfTestDebounce(void)
+{
+  // A clean press and release.
+  static const struct levelScript clean[] = {{10000, 1}, {90000, 0}};
+  static const uint64_t cleanAt[] = {10000};
+  // A press that bounces for 3 ms on the way down and on the way up.
+  static const struct levelScript bouncy[] = {{10000, 1}, {10300, 0}, {10600, 1}, {11000, 0}, {11500, 1}, {13000, 1},
+                                              {90000, 0}, {90400, 1}, {90900, 0}, {91200, 1}, {91600, 0}};
+  static const uint64_t bouncyAt[] = {10000};
+  // A spike shorter than the settle time is noise, not a press.
+  static const struct levelScript spike[] = {{10000, 1}, {12000, 0}};
+  // Three quick presses, 60 ms apart, each held for 30 ms.
+  static const struct levelScript triple[] = {{10000, 1}, {40000, 0}, {70000, 1}, {100000, 0}, {130000, 1}, {160000, 0}};
+  static const uint64_t tripleAt[] = {10000, 70000, 130000};
+  static const struct
+  {
+    const char *name;
+    const struct levelScript *script;
+    int n;
+    const uint64_t *pressAt;
+    int presses, releases;
+  } cases[] = {
+      {"clean press", clean, 2, cleanAt, 1, 1},
+      {"bouncing press", bouncy, 11, bouncyAt, 1, 1},
+      {"short spike", spike, 2, NULL, 0, 0},
+      {"three quick presses", triple, 6, tripleAt, 3, 3},
+  };
+  int failed = 0;
+
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+  {
+    int presses, releases, late;
+
+    runScript(cases[c].script, cases[c].n, 250000, cases[c].pressAt, &presses, &releases, &late);
+    if (presses != cases[c].presses || releases != cases[c].releases || late)
+    {
+      failed++;
+      fprintf(stdout, "FAIL %s: %d presses, %d releases (expected %d, %d), %d badly stamped\n", cases[c].name, presses,
+              releases, cases[c].presses, cases[c].releases, late);
+    }
+    else
+      fprintf(stdout, "ok   %s\n", cases[c].name);
+  }
+  return failed;
+}
+
+/* ======================================================= */
+/* SECTION: solver (consistent candidates and hints)       */
+/* ------------------------------------------------------- */
+/* a configuration: rule variant, number of colours, length of the sequence, and the number of codes in it */
+struct codeSpace
+{
+  const struct variant *v;
+  int colors, len;
+  uint64_t size;
+};
+
+/* one round of a game: the guess and the feedback it got */
+struct histEntry
+{
+  code_t guess;
+  int fb;
+};
+
+/* result of a hint query */
+struct hint
+{
+  code_t guess;       // suggested next guess
+  uint64_t remaining; // number of secrets still consistent with the history
+  int worst;          // largest number of secrets that can remain after the suggested guess
+  int cached;         // 2: answered from the cache, 1: started from a cached prefix, 0: computed from scratch
+  int complete;       // 1 if every possible guess was scored exactly, i.e. this is the minimax guess
+  int cut;            // 1 if the budget ran out while filtering: @remaining@ and @worst@ are only upper bounds
+  double coverage;    // share of the possible guesses scored (exactly, if any were; else against the sample)
+};
+
+void spaceInit(struct codeSpace *sp, const struct variant *v, int colors, int len)
+{
+  sp->v = v;
+  sp->colors = colors;
+  sp->len = len;
+  sp->size = v->size(colors, len);
+}
+
+/* position of @c@ in the enumeration order of the code space, and back */
+static inline uint64_t codeRank(const struct codeSpace *sp, code_t c)
+{
+  return sp->v->rank(c, sp->colors, sp->len);
+}
+
+static inline code_t codeUnrank(const struct codeSpace *sp, uint64_t r)
+{
+  return sp->v->unrank(r, sp->colors, sp->len);
+}
+
+/* ------------------------------------------------------- */
+/* lazy enumeration: a code space is never materialised; codes are addressed by rank, and a range of ranks is   */
+/* walked in packed form (stepping the code in place rather than unranking every rank), a block at a time.       */
+
+/* a half-open range [lo, hi) of ranks */
+struct codeRange
+{
+  uint64_t lo, hi;
+};
+
+struct codeIter
+{
+  const struct codeSpace *sp;
+  uint64_t rank, hi; // rank of @next@, and end of the range
+  code_t next;
+};
+
+void iterInit(struct codeIter *it, const struct codeSpace *sp, struct codeRange range)
+{
+  it->sp = sp;
+  it->rank = range.lo;
+  it->hi = range.hi < sp->size ? range.hi : sp->size;
+  if (it->rank < it->hi)
+    it->next = codeUnrank(sp, it->rank);
+}
+
+/* store up to @max@ further codes of the range in @buf@; returns how many, 0 at the end of the range */
+size_t iterFill(struct codeIter *it, code_t *buf, size_t max)
+{
+  size_t n = 0;
+  int (*next)(code_t *, int, int) = it->sp->v->next;
+
+  while (n < max && it->rank < it->hi)
+  {
+    buf[n++] = it->next;
+    if (++it->rank < it->hi)
+      next(&it->next, it->sp->colors, it->sp->len);
+  }
+  return n;
+}
+
+/* the @k@-th of @parts@ (nearly) equal slices of @range@, for handing out to parallel workers */
+struct codeRange rangeSplit(struct codeRange range, int parts, int k)
+{
+  uint64_t len = range.hi - range.lo, base = len / parts, extra = len % parts;
+  struct codeRange sub;
+
+  sub.lo = range.lo + k * base + (k < (int)extra ? (uint64_t)k : extra);
+  sub.hi = sub.lo + base + (k < (int)extra ? 1 : 0);
+  return sub;
+}
+
+/* the whole code space as a range */
+struct codeRange spaceRange(const struct codeSpace *sp)
+{
+  struct codeRange all = {0, sp->size};
+
+  return all;
+}
+
+/* one worker of spaceFilter: filters its own slice of the code space into its own array */
+struct filterJob
+{
+  const struct codeSpace *sp;
+  const struct histEntry *h;
+  struct codeRange range;
+  uint64_t deadline; // stop when this time has passed (0 for never)
+  int cut;           // set if the worker stopped at the deadline
+  code_t *out;
+  size_t n;
+};
+
+static void *filterWorker(void *arg)
+{
+  struct filterJob *job = (struct filterJob *)arg;
+  const struct codeSpace *sp = job->sp;
+  struct codeIter it;
+  size_t cap = 1024, got;
+  code_t block[FILTER_BLOCK];
+
+  job->out = (code_t *)malloc(cap * sizeof(code_t));
+  job->n = 0;
+  job->cut = 0;
+  if (job->out == NULL)
+    return NULL;
+  iterInit(&it, sp, job->range);
+  while ((got = iterFill(&it, block, FILTER_BLOCK)) > 0)
+  {
+    if (job->deadline && piTimeNow() >= job->deadline)
+    {
+      job->cut = 1;
+      break;
+    }
+    if (job->h != NULL)
+      got = sp->v->filter(block, got, job->h->guess, job->h->fb, sp->len);
+    if (job->n + got > cap)
+    {
+      code_t *grown;
+
+      while (job->n + got > cap)
+        cap *= 2;
+      if ((grown = (code_t *)realloc(job->out, cap * sizeof(code_t))) == NULL)
+      {
+        free(job->out);
+        job->out = NULL;
+        return NULL;
+      }
+      job->out = grown;
+    }
+    memcpy(job->out + job->n, block, got * sizeof(code_t));
+    job->n += got;
+  }
+  return NULL;
+}
+
+/* enumerate the full code space, keeping only codes consistent with @h@; the result is in rank order, or NULL if */
+/* memory ran out. Large spaces are split into rank ranges, one per CPU; only the survivors are ever stored.     */
+/* With a @deadline@ (0 for none) the enumeration stops once it has passed, and *@cut@ (if given) is set: the   */
+/* result then only holds the survivors found until then.                                                        */
+code_t *spaceFilter(const struct codeSpace *sp, const struct histEntry *h, uint64_t deadline, size_t *count, int *cut)
+{
+  int workers = sp->size >= PARALLEL_MIN_CODES ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+  struct filterJob job[MAX_WORKERS];
+  pthread_t tid[MAX_WORKERS];
+  int started[MAX_WORKERS];
+  code_t *out;
+  size_t n = 0;
+
+  if (workers < 1)
+    workers = 1;
+  if (workers > MAX_WORKERS)
+    workers = MAX_WORKERS;
+
+  for (int k = 0; k < workers; k++)
+  {
+    job[k].sp = sp;
+    job[k].h = h;
+    job[k].range = rangeSplit(spaceRange(sp), workers, k);
+    job[k].deadline = deadline;
+    started[k] = k > 0 && pthread_create(&tid[k], NULL, filterWorker, &job[k]) == 0;
+  }
+
+  // We do the first slice ourselves (and any slice whose thread could not be started).
+
+  for (int k = 0; k < workers; k++)
+    if (!started[k])
+      filterWorker(&job[k]);
+  for (int k = 0; k < workers; k++)
+    if (started[k])
+      pthread_join(tid[k], NULL);
+
+  // The slices are consecutive rank ranges, so concatenating them in order keeps the result in rank order.
+
+  for (int k = 0; k < workers; k++)
+    n += job[k].n;
+  out = (code_t *)malloc((n ? n : 1) * sizeof(code_t));
+  for (int k = 0; k < workers; k++)
+    if (job[k].out == NULL)
+    {
+      free(out);
+      out = NULL;
+    }
+  n = 0;
+  for (int k = 0; k < workers; k++)
+  {
+    if (out != NULL)
+      memcpy(out + n, job[k].out, job[k].n * sizeof(code_t));
+    n += job[k].n;
+    free(job[k].out);
+  }
+  *count = out != NULL ? n : 0;
+  if (cut)
+  {
+    *cut = 0;
+    for (int k = 0; k < workers; k++)
+      *cut |= job[k].cut;
+  }
+  return out;
+}
+
+/* the guess whose largest feedback class among @codes@ is smallest (minimax); candidates win ties. For small   */
+/* spaces every code is tried as a guess, otherwise only the candidates themselves.                            */
+code_t bestGuess(const struct codeSpace *sp, const code_t *codes, size_t n, int *worst)
+{
+  unsigned int part[FB_CLASSES];
+  code_t best = n ? codes[0] : codeUnrank(sp, 0);
+  uint64_t guesses = sp->size <= HINT_FULL_SPACE ? sp->size : n;
+  int bestWorst = INT32_MAX, bestIsCand = 0;
+  size_t ci = 0;
+
+  for (uint64_t g = 0; g < guesses; g++)
+  {
+    code_t guess = sp->size <= HINT_FULL_SPACE ? codeUnrank(sp, g) : codes[g];
+    int w, isCand;
+
+    // codes[] is in rank order, so walking it alongside the ranks tells us whether this guess is a candidate.
+
+    while (sp->size <= HINT_FULL_SPACE && ci < n && codeRank(sp, codes[ci]) < g)
+      ci++;
+    isCand = sp->size > HINT_FULL_SPACE || (ci < n && codes[ci] == guess);
+
+    memset(part, 0, sizeof(part));
+    w = sp->v->partition(codes, n, guess, sp->len, part);
+    if (w < bestWorst || (w == bestWorst && isCand && !bestIsCand))
+    {
+      best = guess;
+      bestWorst = w;
+      bestIsCand = isCand;
+    }
+  }
+  if (worst)
+    *worst = bestWorst == INT32_MAX ? 0 : bestWorst;
+  return best;
+}
+
+/* ------------------------------------------------------- */
+/* anytime search for the next guess, for hints with a hard latency budget: a quick pick first, then the guesses */
+/* scored against a sample of the candidates, then the most promising of them (and, time permitting, all of      */
+/* them) scored exactly. Whatever is best when the deadline passes is the answer.                                */
+
+/* the @i@-th guess to try: the candidates first, then (for small spaces) every code */
+static inline code_t poolGuess(const struct codeSpace *sp, const code_t *codes, size_t n, uint64_t i)
+{
+  return i < n ? codes[i] : codeUnrank(sp, i - n);
+}
+
+struct scoredGuess
+{
+  code_t guess;
+  int worst;
+  int isCand;
+};
+
+/* keep @top@ (of @k@ entries, up to HINT_TOPK) sorted by worst case, smallest first; candidates win ties */
+static int topInsert(struct scoredGuess *top, int k, struct scoredGuess g)
+{
+  int i;
+
+  if (k == HINT_TOPK && (g.worst > top[k - 1].worst || (g.worst == top[k - 1].worst && (!g.isCand || top[k - 1].isCand))))
+    return k;
+  if (k < HINT_TOPK)
+    k++;
+  for (i = k - 1; i > 0 && (top[i - 1].worst > g.worst || (top[i - 1].worst == g.worst && g.isCand && !top[i - 1].isCand)); i--)
+    top[i] = top[i - 1];
+  top[i] = g;
+  return k;
+}
+
+void anytimeGuess(const struct codeSpace *sp, const code_t *codes, size_t n, uint64_t deadline, struct hint *out)
+{
+  unsigned int part[FB_CLASSES];
+  uint64_t pool = n + (sp->size <= HINT_FULL_SPACE ? sp->size : 0), sampledDone = 0, exactDone = 0;
+  size_t sn = n < HINT_SAMPLE ? n : HINT_SAMPLE;
+  code_t *sample = (code_t *)malloc((sn ? sn : 1) * sizeof(code_t));
+  struct scoredGuess top[HINT_TOPK], cur;
+  int k = 0, bestWorst = INT32_MAX, bestIsCand = 0;
+
+  // Stage 1: a candidate is always a reasonable guess, and it costs nothing.
+
+  out->guess = n ? codes[0] : codeUnrank(sp, 0);
+  out->worst = (int)n;
+  out->complete = 0;
+  out->cut = 0;
+  out->coverage = 0.0;
+  if (sample == NULL)
+    return;
+
+  // Stage 2: every guess is scored against an evenly spaced sample of the candidates, which keeps the cost per guess
+  // bounded however many candidates there are. If the sample is all candidates, this is exact already.
+
+  // Unless the sample is exact, this stage may only use half of the time left, so that the next one gets its share.
+
+  uint64_t now = piTimeNow(), stop = sn == n ? deadline : now + (deadline > now ? (deadline - now) / 2 : 0);
+
+  for (size_t i = 0; i < sn; i++)
+    sample[i] = codes[(i * n) / sn];
+  for (; sampledDone < pool && (sampledDone & 15 || piTimeNow() < stop); sampledDone++)
+  {
+    cur.guess = poolGuess(sp, codes, n, sampledDone);
+    cur.isCand = sampledDone < n;
+    memset(part, 0, sizeof(part));
+    cur.worst = sp->v->partition(sample, sn, cur.guess, sp->len, part);
+    k = topInsert(top, k, cur);
+  }
+  free(sample);
+
+  if (sn == n)
+  {
+    if (k > 0)
+    {
+      out->guess = top[0].guess;
+      out->worst = top[0].worst;
+    }
+    exactDone = sampledDone;
+    out->complete = sampledDone == pool;
+    out->coverage = pool ? (double)exactDone / pool : 1.0;
+    return;
+  }
+
+  // Until something has been scored exactly, the best of the sample stands, with its worst case scaled up.
+
+  if (k > 0)
+  {
+    out->guess = top[0].guess;
+    out->worst = (int)(((uint64_t)top[0].worst * n + sn - 1) / sn);
+  }
+
+  // Stage 3: the most promising guesses of the sample are scored exactly, best first.
+
+  for (int i = 0; i < k && piTimeNow() < deadline; i++)
+  {
+    memset(part, 0, sizeof(part));
+    top[i].worst = sp->v->partition(codes, n, top[i].guess, sp->len, part);
+    if (top[i].worst < bestWorst || (top[i].worst == bestWorst && top[i].isCand && !bestIsCand))
+    {
+      bestWorst = top[i].worst;
+      bestIsCand = top[i].isCand;
+      out->guess = top[i].guess;
+      out->worst = bestWorst;
+    }
+  }
+
+  // Stage 4: with time to spare, every guess is scored exactly; finishing this is the full minimax search. As in
+  // bestGuess(), a candidate wins a tie, as it might be the secret itself.
+
+  for (; exactDone < pool && piTimeNow() < deadline; exactDone++)
+  {
+    code_t g = poolGuess(sp, codes, n, exactDone);
+    int w, isCand = exactDone < n;
+
+    memset(part, 0, sizeof(part));
+    w = sp->v->partition(codes, n, g, sp->len, part);
+    if (w < bestWorst || (w == bestWorst && isCand && !bestIsCand))
+    {
+      bestWorst = w;
+      bestIsCand = isCand;
+      out->guess = g;
+      out->worst = w;
+    }
+  }
+  out->complete = exactDone == pool;
+  out->coverage = pool ? (exactDone ? (double)exactDone / pool : (double)sampledDone * sn / ((double)pool * n)) : 1.0;
+}
+
+/* ------------------------------------------------------- */
+/* compressed candidate sets: ranks in increasing order, delta-encoded as LEB128 varints */
+
+/* encode @n@ codes into @buf@, which must have room for 10 bytes per code; returns the number of bytes used */
+size_t encodeCands(const struct codeSpace *sp, const code_t *codes, size_t n, unsigned char *buf)
+{
+  uint64_t prev = 0;
+  size_t len = 0;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    uint64_t r = codeRank(sp, codes[i]), d = r - prev;
+
+    prev = r;
+    while (d >= 0x80)
+    {
+      buf[len++] = (unsigned char)(d | 0x80);
+      d >>= 7;
+    }
+    buf[len++] = (unsigned char)d;
+  }
+  return len;
+}
+
+unsigned char *packCands(const struct codeSpace *sp, const code_t *codes, size_t n, size_t *bytes)
+{
+  unsigned char *buf = (unsigned char *)malloc(n * 10 + 1), *fit;
+
+  *bytes = 0;
+  if (buf == NULL)
+    return NULL;
+  *bytes = encodeCands(sp, codes, n, buf);
+  fit = (unsigned char *)realloc(buf, *bytes ? *bytes : 1);
+  return fit != NULL ? fit : buf;
+}
+
+/* decode @n@ codes from the @bytes@ bytes at @buf@ into @codes@; returns -1 if @buf@ does not hold @n@ valid */
+/* codes (it may come from a file): a varint runs past the end or beyond 64 bits, or a rank is out of the space */
+int unpackCands(const struct codeSpace *sp, const unsigned char *buf, size_t bytes, size_t n, code_t *codes)
+{
+  const unsigned char *end = buf + bytes;
+  uint64_t r = 0;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    uint64_t d = 0;
+    int shift = 0;
+
+    do
+    {
+      if (buf == end || shift >= 64)
+        return -1;
+      d |= (uint64_t)(*buf & 0x7F) << shift, shift += 7;
+    } while (*buf++ & 0x80);
+    if (d >= sp->size - r)
+      return -1;
+    r += d;
+    codes[i] = codeUnrank(sp, r);
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------- */
+/* hint cache: a bounded LRU map from a history (as a set of (guess, feedback) pairs, so the order in which the */
+/* rounds were played does not matter) to its compressed candidate set and, once computed, the best next guess. */
+/* Entries are found by a hash of the history, but every entry keeps the history itself to check a match: two  */
+/* histories with the same hash would otherwise get each other's candidates.                                    */
+
+struct hintEntry
+{
+  uint64_t key;
+  const struct variant *v; // the code space of the history
+  int colors, len;
+  int depth;              // number of rounds in the history
+  struct histEntry *hist; // the history, sorted as for its key
+  unsigned char *set;     // compressed candidates (NULL for the empty history, i.e. the full space)
+  size_t setBytes, count;
+  int hasBest, bestWorst;
+  code_t best;
+  struct hintEntry *chain;      // next entry in the same hash bucket
+  struct hintEntry *prev, *next; // LRU list, most recently used first
+};
+
+static struct
+{
+  struct hintEntry *bucket[HINT_CACHE_BUCKETS];
+  struct hintEntry *mru, *lru;
+  size_t bytes, entries;
+  unsigned long hits, partial, misses;
+  pthread_mutex_t lock;
+} hintCache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t mix64(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static int histCmp(const void *a, const void *b)
+{
+  const struct histEntry *x = (const struct histEntry *)a, *y = (const struct histEntry *)b;
+
+  if (x->guess != y->guess)
+    return x->guess < y->guess ? -1 : 1;
+  return x->fb - y->fb;
+}
+
+/* the first @depth@ rounds of @h@ in canonical order, into @sorted@ */
+static void histSort(const struct histEntry *h, int depth, struct histEntry *sorted)
+{
+  memcpy(sorted, h, depth * sizeof(struct histEntry));
+  qsort(sorted, depth, sizeof(struct histEntry), histCmp);
+}
+
+/* canonical key of the first @depth@ rounds of @h@: the pairs are sorted before hashing */
+uint64_t histKey(const struct codeSpace *sp, const struct histEntry *h, int depth)
+{
+  struct histEntry sorted[depth > 0 ? depth : 1];
+  uint64_t key = mix64(((uint64_t)(sp->v - variants) << 16) | ((uint64_t)sp->colors << 8) | sp->len);
+
+  histSort(h, depth, sorted);
+  for (int i = 0; i < depth; i++)
+    key = mix64(key ^ mix64(sorted[i].guess ^ ((uint64_t)sorted[i].fb << 56)));
+  return key;
+}
+
+static void hintUnlink(struct hintEntry *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    hintCache.mru = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    hintCache.lru = e->prev;
+}
+
+static void hintPushFront(struct hintEntry *e)
+{
+  e->prev = NULL;
+  e->next = hintCache.mru;
+  if (hintCache.mru)
+    hintCache.mru->prev = e;
+  hintCache.mru = e;
+  if (!hintCache.lru)
+    hintCache.lru = e;
+}
+
+/* whether entry @e@ holds the first @depth@ rounds of @h@ (already sorted) in code space @sp@ */
+static int hintSame(const struct hintEntry *e, const struct codeSpace *sp, const struct histEntry *sorted, int depth)
+{
+  if (e->depth != depth || e->v != sp->v || e->colors != sp->colors || e->len != sp->len)
+    return 0;
+  for (int i = 0; i < depth; i++)
+    if (e->hist[i].guess != sorted[i].guess || e->hist[i].fb != sorted[i].fb)
+      return 0;
+  return 1;
+}
+
+/* look up the first @depth@ rounds of @h@, with key @key@, and mark the entry most recently used; the cache lock */
+/* must be held                                                                                                   */
+static struct hintEntry *hintFind(const struct codeSpace *sp, const struct histEntry *h, uint64_t key, int depth)
+{
+  struct histEntry sorted[depth > 0 ? depth : 1];
+  struct hintEntry *e;
+  int isSorted = 0;
+
+  for (e = hintCache.bucket[key % HINT_CACHE_BUCKETS]; e != NULL; e = e->chain)
+    if (e->key == key && e->depth == depth)
+    {
+      // Only a matching hash makes the history worth sorting.
+
+      if (!isSorted)
+        histSort(h, depth, sorted), isSorted = 1;
+      if (!hintSame(e, sp, sorted, depth))
+        continue;
+      hintUnlink(e);
+      hintPushFront(e);
+      return e;
+    }
+  return NULL;
+}
+
+/* drop least recently used entries until the cache is within its budget; the cache lock must be held */
+static void hintEvict(void)
+{
+  while (hintCache.lru && (hintCache.bytes > HINT_CACHE_BYTES || hintCache.entries > HINT_CACHE_ENTRIES))
+  {
+    struct hintEntry *e = hintCache.lru, **p = &hintCache.bucket[e->key % HINT_CACHE_BUCKETS];
+
+    while (*p != e)
+      p = &(*p)->chain;
+    *p = e->chain;
+    hintUnlink(e);
+    hintCache.bytes -= sizeof(struct hintEntry) + e->depth * sizeof(struct histEntry) + e->setBytes;
+    hintCache.entries--;
+    free(e->hist);
+    free(e->set);
+    free(e);
+  }
+}
+
+/* add the candidate set for the first @depth@ rounds of @h@ to the cache (unless present), returning its entry, or */
+/* NULL if the set alone is too large for the cache or memory ran out. @set@ is the set packed with packCands()     */
+/* (NULL for the empty history), which the cache takes over (and frees if it is not kept); lock must be held        */
+static struct hintEntry *hintStore(const struct codeSpace *sp, const struct histEntry *h, uint64_t key, int depth,
+                                   unsigned char *set, size_t setBytes, size_t n)
+{
+  struct hintEntry *e = hintFind(sp, h, key, depth);
+  size_t histBytes = depth * sizeof(struct histEntry);
+
+  if (e != NULL || sizeof(struct hintEntry) + histBytes + setBytes > HINT_CACHE_BYTES ||
+      (e = (struct hintEntry *)calloc(1, sizeof(struct hintEntry))) == NULL)
+  {
+    free(set);
+    return e;
+  }
+  if ((e->hist = (struct histEntry *)malloc(histBytes ? histBytes : 1)) == NULL)
+  {
+    free(set);
+    free(e);
+    return NULL;
+  }
+  histSort(h, depth, e->hist);
+  e->key = key;
+  e->v = sp->v;
+  e->colors = sp->colors;
+  e->len = sp->len;
+  e->depth = depth;
+  e->count = n;
+  e->set = set;
+  e->setBytes = setBytes;
+
+  // An entry that fits on its own is never evicted by its own insertion, as the LRU end is evicted first.
+
+  e->chain = hintCache.bucket[key % HINT_CACHE_BUCKETS];
+  hintCache.bucket[key % HINT_CACHE_BUCKETS] = e;
+  hintPushFront(e);
+  hintCache.bytes += sizeof(struct hintEntry) + histBytes + e->setBytes;
+  hintCache.entries++;
+  hintEvict();
+  return e;
+}
+
+/* pack the candidates of the first @depth@ rounds of @h@ and cache them; the packing is done without the lock */
+static void hintAdd(const struct codeSpace *sp, const struct histEntry *h, uint64_t key, int depth, const code_t *codes,
+                    size_t n)
+{
+  unsigned char *set = NULL;
+  size_t setBytes = 0;
+
+  if (depth > 0 && (set = packCands(sp, codes, n, &setBytes)) == NULL)
+    return;
+  pthread_mutex_lock(&hintCache.lock);
+  hintStore(sp, h, key, depth, set, setBytes, n);
+  pthread_mutex_unlock(&hintCache.lock);
+}
+
+/* filter @n@ @codes@ by round @h@ in blocks, stopping once @deadline@ (0 for none) has passed; *@cut@ is set if */
+/* it did, and only the survivors of the blocks done until then are kept                                         */
+static size_t filterUntil(const struct codeSpace *sp, code_t *codes, size_t n, const struct histEntry *h,
+                          uint64_t deadline, int *cut)
+{
+  size_t kept = 0;
+
+  *cut = 0;
+  for (size_t i = 0; i < n; i += FILTER_BLOCK)
+  {
+    size_t got = n - i < FILTER_BLOCK ? n - i : FILTER_BLOCK;
+
+    if (deadline && piTimeNow() >= deadline)
+    {
+      *cut = 1;
+      break;
+    }
+    got = sp->v->filter(codes + i, got, h->guess, h->fb, sp->len);
+    memmove(codes + kept, codes + i, got * sizeof(code_t));
+    kept += got;
+  }
+  return kept;
+}
+
+/* the answer when the budget ran out while filtering: @codes@ (@n@) are consistent with the rounds before @from@; */
+/* the first (of at most a block) that is also consistent with the rest of the @depth@ rounds of @h@ is the guess  */
+static void hintCut(const struct codeSpace *sp, const struct histEntry *h, int from, int depth, const code_t *codes,
+                    size_t n, uint64_t bound, struct hint *out)
+{
+  out->guess = n ? codes[0] : codeUnrank(sp, 0);
+  for (size_t i = 0; i < n && i < FILTER_BLOCK; i++)
+  {
+    int r = from;
+
+    while (r < depth && sp->v->score(codes[i], h[r].guess, sp->len) == h[r].fb)
+      r++;
+    if (r == depth)
+    {
+      out->guess = codes[i];
+      break;
+    }
+  }
+  out->remaining = bound;
+  out->worst = bound > INT32_MAX ? INT32_MAX : (int)bound;
+  out->complete = 0;
+  out->cut = 1;
+  out->coverage = 0.0;
+}
+
+/* the secrets still possible after history @h@ (@n@ rounds), and the best next guess. We start from the longest */
+/* cached prefix of the history and filter the remaining rounds one by one, caching every prefix on the way.     */
+/* With a @budget@ (in us, 0 for none) the answer is the best guess found in time; only complete answers are     */
+/* cached. The @budget@ covers the filtering as well: if it runs out there, the hint is only a code consistent     */
+/* with as many rounds as were filtered (see hintCut). The lock is only held to look up and add entries: a cached */
+/* set is copied out and unpacked without it, so that queries for other histories are not held up. Returns -1 if */
+/* memory ran out.                                                                                               */
+int hintQuery(const struct codeSpace *sp, const struct histEntry *h, int n, uint64_t budget, struct hint *out)
+{
+  uint64_t deadline = budget ? piTimeNow() + budget : 0;
+  uint64_t keys[n + 1];
+  struct hintEntry *e = NULL;
+  unsigned char *set = NULL;
+  code_t *codes = NULL;
+  size_t count = 0, setBytes = 0;
+  int depth, cut = 0;
+
+  for (int k = 0; k <= n; k++)
+    keys[k] = histKey(sp, h, k);
+
+  pthread_mutex_lock(&hintCache.lock);
+  for (depth = n; depth >= 0; depth--)
+    if ((e = hintFind(sp, h, keys[depth], depth)) != NULL)
+      break;
+
+  if (e != NULL && depth == n && e->hasBest)
+  {
+    hintCache.hits++;
+    out->guess = e->best;
+    out->worst = e->bestWorst;
+    out->remaining = depth ? e->count : sp->size;
+    out->cached = 2;
+    out->complete = 1;
+    out->cut = 0;
+    out->coverage = 1.0;
+    pthread_mutex_unlock(&hintCache.lock);
+    return 0;
+  }
+
+  // The entry may be evicted as soon as we let go of the lock, so we take a copy of its compressed set.
+
+  if (e != NULL && e->set != NULL && (set = (unsigned char *)malloc(e->setBytes ? e->setBytes : 1)) != NULL)
+  {
+    memcpy(set, e->set, e->setBytes);
+    setBytes = e->setBytes;
+    count = e->count;
+  }
+  if (e != NULL)
+    hintCache.partial++;
+  else
+    hintCache.misses++;
+  out->cached = e != NULL;
+  pthread_mutex_unlock(&hintCache.lock);
+
+  // We unpack the cached prefix, or enumerate the code space (already applying the first round) if there is none.
+
+  if (set != NULL)
+  {
+    if ((codes = (code_t *)malloc((count ? count : 1) * sizeof(code_t))) == NULL ||
+        unpackCands(sp, set, setBytes, count, codes) < 0)
+    {
+      free(set);
+      free(codes);
+      return -1;
+    }
+    free(set);
+  }
+  else
+  {
+    if ((codes = spaceFilter(sp, n > 0 ? &h[0] : NULL, deadline, &count, &cut)) == NULL)
+      return -1;
+    if (cut)
+    {
+      hintCut(sp, h, 1, n, codes, count, sp->size, out);
+      free(codes);
+      return 0;
+    }
+    depth = n > 0 ? 1 : 0;
+    hintAdd(sp, h, keys[depth], depth, codes, count);
+  }
+
+  // Only complete prefixes are cached; a round cut short by the deadline leaves a hint consistent with the rounds
+  // before it, and a code that fits the later rounds where one is at hand.
+
+  for (; depth < n; depth++)
+  {
+    size_t before = count;
+
+    count = filterUntil(sp, codes, count, &h[depth], deadline, &cut);
+    if (cut)
+    {
+      hintCut(sp, h, depth + 1, n, codes, count, before, out);
+      free(codes);
+      return 0;
+    }
+    hintAdd(sp, h, keys[depth + 1], depth + 1, codes, count);
+  }
+
+  if (deadline)
+    anytimeGuess(sp, codes, count, deadline, out);
+  else
+  {
+    out->guess = bestGuess(sp, codes, count, &out->worst);
+    out->complete = 1;
+    out->cut = 0;
+    out->coverage = 1.0;
+  }
+  out->remaining = count;
+  free(codes);
+  if (!out->complete)
+    return 0;
+
+  pthread_mutex_lock(&hintCache.lock);
+  if ((e = hintFind(sp, h, keys[n], n)) != NULL)
+  {
+    e->best = out->guess;
+    e->bestWorst = out->worst;
+    e->hasBest = 1;
+  }
+  pthread_mutex_unlock(&hintCache.lock);
+  return 0;
+}
+
+/* print the hit rate of the hint cache (with -v) */
+void hintReport(void)
+{
+  pthread_mutex_lock(&hintCache.lock);
+  logMsg(LOG_VERBOSE, stdout, "hint cache: %lu hits, %lu from a cached prefix, %lu misses; %zu entries, %zu bytes\n",
+         hintCache.hits, hintCache.partial, hintCache.misses, hintCache.entries, hintCache.bytes);
+  pthread_mutex_unlock(&hintCache.lock);
+}
+
+/* ======================================================= */
+/* SECTION: candidate files (out-of-core filtering, -O)    */
+/* ------------------------------------------------------- */
+/* For configurations whose candidate sets do not fit in memory, the filter streams the code space (or a candidate   */
+/* file written earlier) through a pipeline of a reader thread, filter threads and the writer, in blocks of        */
+/* STREAM_BLOCK codes. The blocks live in a fixed set of slots, so memory use does not depend on the configuration. */
+/* A candidate file is a header followed by frames of at most STREAM_BLOCK codes, each encoded like the sets of the */
+/* hint cache (rank deltas as varints, starting from 0 in every frame), so frames are encoded in parallel.          */
+
+#define CANDFILE_MAGIC 0x46434d4du // "MMCF"
+#define CANDFILE_VERSION 1
+
+struct candFileHeader
+{
+  uint32_t magic, version;
+  char variant[16];
+  int32_t colors, len;
+  uint64_t count; // number of codes in the file
+};
+
+struct candFrame
+{
+  uint32_t codes, bytes;
+};
+
+enum slotState
+{
+  SLOT_FREE,     // waiting for the reader
+  SLOT_READ,     // waiting for a filter thread
+  SLOT_BUSY,     // being filtered
+  SLOT_FILTERED  // waiting for the writer
+};
+
+struct streamSlot
+{
+  enum slotState state;
+  uint64_t seq; // position of the block in the stream; the writer takes the blocks in this order
+  code_t *codes;
+  unsigned char *bytes;
+  size_t n, nBytes;
+};
+
+struct stream
+{
+  const struct codeSpace *sp;
+  const struct histEntry *h;
+  int nh;
+
+  FILE *in;           // a candidate file, or NULL to enumerate the code space with @it@
+  struct codeIter it;
+  uint64_t inLeft;    // codes still to come from @in@
+
+  struct streamSlot *slot;
+  int nSlots;
+  uint64_t readSeq, writeSeq;
+  int readDone, failed;
+  uint64_t codesIn;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/* the next block of input into @sl@; returns 0 at the end of the input, -1 on a broken candidate file */
+static int streamFill(struct stream *s, struct streamSlot *sl)
+{
+  struct candFrame f;
+
+  if (s->in == NULL)
+  {
+    sl->n = iterFill(&s->it, sl->codes, STREAM_BLOCK);
+    return sl->n > 0;
+  }
+  if (s->inLeft == 0)
+    return 0;
+  if (fread(&f, sizeof(f), 1, s->in) != 1 || f.codes == 0 || f.codes > STREAM_BLOCK || f.codes > s->inLeft ||
+      f.bytes > (size_t)STREAM_BLOCK * 10 || fread(sl->bytes, 1, f.bytes, s->in) != f.bytes ||
+      unpackCands(s->sp, sl->bytes, f.bytes, f.codes, sl->codes) < 0)
+    return -1;
+  sl->n = f.codes;
+  s->inLeft -= f.codes;
+  return 1;
+}
+
+/* reader thread: fills free slots in stream order */
+static void *streamReader(void *arg)
+{
+  struct stream *s = (struct stream *)arg;
+
+  for (;;)
+  {
+    struct streamSlot *sl = NULL;
+    int got;
+
+    pthread_mutex_lock(&s->lock);
+    while (sl == NULL && !s->failed)
+    {
+      for (int k = 0; k < s->nSlots && sl == NULL; k++)
+        if (s->slot[k].state == SLOT_FREE)
+          sl = &s->slot[k];
+      if (sl == NULL)
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (sl == NULL)
+      break;
+
+    // The slot is ours until we mark it read, so it is filled outside the lock.
+
+    got = streamFill(s, sl);
+    pthread_mutex_lock(&s->lock);
+    if (got > 0)
+    {
+      sl->seq = s->readSeq++;
+      sl->state = SLOT_READ;
+      s->codesIn += sl->n;
+    }
+    else
+    {
+      if (got < 0)
+        s->failed = 1;
+      s->readDone = 1;
+    }
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    if (got <= 0)
+      break;
+  }
+  return NULL;
+}
+
+/* filter thread: applies every constraint to a read block with the batch kernel of the variant, then encodes it */
+static void *streamWorker(void *arg)
+{
+  struct stream *s = (struct stream *)arg;
+  const struct codeSpace *sp = s->sp;
+
+  for (;;)
+  {
+    struct streamSlot *sl = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;)
+    {
+      for (int k = 0; k < s->nSlots && sl == NULL; k++)
+        if (s->slot[k].state == SLOT_READ)
+          sl = &s->slot[k];
+      if (sl != NULL || s->readDone || s->failed)
+        break;
+      pthread_cond_wait(&s->cond, &s->lock);
+    }
+    if (sl != NULL)
+      sl->state = SLOT_BUSY;
+    pthread_mutex_unlock(&s->lock);
+    if (sl == NULL)
+      break;
+
+    for (int i = 0; i < s->nh && sl->n > 0; i++)
+      sl->n = sp->v->filter(sl->codes, sl->n, s->h[i].guess, s->h[i].fb, sp->len);
+    sl->nBytes = encodeCands(sp, sl->codes, sl->n, sl->bytes);
+
+    pthread_mutex_lock(&s->lock);
+    sl->state = SLOT_FILTERED;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+/* parse a constraint @guess@:@exact@:@approx@, the guess as one hex digit per peg (peg 1 first) */
+static int parseConstraint(const char *arg, const struct codeSpace *sp, struct histEntry *h)
+{
+  int seq[16], exact, approx, n = 0;
+  const char *p = arg;
+
+  for (; *p != ':' && *p != '\0'; p++, n++)
+  {
+    int c = (*p >= '0' && *p <= '9') ? *p - '0' : (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 : -1;
+
+    if (c < (sp->v->blanks ? 0 : 1) || c > sp->colors || n == sp->len)
+      return -1;
+    seq[n] = c;
+  }
+  if (n != sp->len || sscanf(p, ":%d:%d", &exact, &approx) != 2 || exact < 0 || approx < 0 || exact + approx > sp->len)
+    return -1;
+  h->guess = packSeq(seq, n);
+  h->fb = FB(exact, approx);
+  return 0;
+}
+
+/* filter the code space of the game, or the candidates in file @inPath@ (which then sets the configuration, and   */
+/* must match the game's if @strict@, i.e. -C, -L or -V were given), by the constraints @args@ into the candidate */
+/* file @outPath@; returns 0 on success                                                                           */
+int streamFilter(const char *inPath, const char *outPath, char **args, int nArgs, int strict)
+{
+  struct codeSpace sp;
+  struct candFileHeader hdr;
+  struct stream s;
+  struct histEntry *h = NULL;
+  pthread_t reader, tid[MAX_WORKERS];
+  int workers = (int)sysconf(_SC_NPROCESSORS_ONLN), started = 0, ok = 0, locked = 0;
+  uint64_t count = 0, bytes = sizeof(hdr), t0 = piTimeNow();
+  FILE *out = NULL;
+
+  // Every failure below jumps to done, which releases whatever had been set up by then.
+
+  memset(&s, 0, sizeof(s));
+  spaceInit(&sp, gameVariant, colors, seqlen);
+  if (inPath != NULL)
+  {
+    const struct variant *v;
+
+    if ((s.in = fopen(inPath, "rb")) == NULL || fread(&hdr, sizeof(hdr), 1, s.in) != 1 ||
+        hdr.magic != CANDFILE_MAGIC || hdr.version != CANDFILE_VERSION ||
+        memchr(hdr.variant, '\0', sizeof(hdr.variant)) == NULL || (v = findVariant(hdr.variant)) == NULL ||
+        hdr.colors < 2 || hdr.colors > STREAM_MAX_COLS || hdr.len < 1 || hdr.len > STREAM_MAX_SEQL ||
+        hdr.count > v->size(hdr.colors, hdr.len))
+    {
+      fprintf(stderr, "%s: not a candidate file\n", inPath);
+      goto done;
+    }
+    if (strict && (v != gameVariant || hdr.colors != colors || hdr.len != seqlen))
+    {
+      fprintf(stderr, "%s holds %s %dx%d, not the %s %dx%d given with -V/-C/-L\n", inPath, v->name, hdr.colors,
+              hdr.len, gameVariant->name, colors, seqlen);
+      goto done;
+    }
+    spaceInit(&sp, v, hdr.colors, hdr.len);
+    s.inLeft = hdr.count;
+    setvbuf(s.in, NULL, _IOFBF, STREAM_IO_BUFFER);
+  }
+  else
+    iterInit(&s.it, &sp, spaceRange(&sp));
+
+  if ((h = (struct histEntry *)malloc((nArgs ? nArgs : 1) * sizeof(struct histEntry))) == NULL)
+    goto done;
+  for (int i = 0; i < nArgs; i++)
+    if (parseConstraint(args[i], &sp, &h[i]) < 0)
+    {
+      fprintf(stderr, "Bad constraint %s (expected <guess>:<exact>:<approx>, the guess with %d pegs of 1 to %d)\n",
+              args[i], sp.len, sp.colors);
+      goto done;
+    }
+
+  if ((out = fopen(outPath, "wb")) == NULL)
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", outPath, strerror(errno));
+    goto done;
+  }
+  setvbuf(out, NULL, _IOFBF, STREAM_IO_BUFFER);
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = CANDFILE_MAGIC;
+  hdr.version = CANDFILE_VERSION;
+  strncpy(hdr.variant, sp.v->name, sizeof(hdr.variant) - 1);
+  hdr.colors = sp.colors;
+  hdr.len = sp.len;
+  fwrite(&hdr, sizeof(hdr), 1, out);
+
+  if (workers < 1)
+    workers = 1;
+  if (workers > MAX_WORKERS)
+    workers = MAX_WORKERS;
+  s.sp = &sp;
+  s.h = h;
+  s.nh = nArgs;
+  s.nSlots = STREAM_SLOTS_PER_WORKER * workers + 2;
+  if ((s.slot = (struct streamSlot *)calloc(s.nSlots, sizeof(struct streamSlot))) == NULL)
+    goto done;
+  for (int k = 0; k < s.nSlots; k++)
+    if ((s.slot[k].codes = (code_t *)malloc(STREAM_BLOCK * sizeof(code_t))) == NULL ||
+        (s.slot[k].bytes = (unsigned char *)malloc(STREAM_BLOCK * 10)) == NULL)
+    {
+      fprintf(stderr, "Cannot allocate the stream buffers\n");
+      goto done;
+    }
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.cond, NULL);
+  locked = 1;
+
+  if (pthread_create(&reader, NULL, streamReader, &s) != 0)
+  {
+    fprintf(stderr, "Cannot start the reader thread\n");
+    goto done;
+  }
+  for (int k = 0; k < workers; k++)
+    if (pthread_create(&tid[started], NULL, streamWorker, &s) == 0)
+      started++;
+  if (started == 0)
+  {
+    fprintf(stderr, "Cannot start the filter threads\n");
+    pthread_mutex_lock(&s.lock);
+    s.failed = 1;
+    pthread_mutex_unlock(&s.lock);
+  }
+
+  // We are the writer: blocks are written in stream order, so the file stays in rank order, whichever filter thread
+  // finished first. Empty blocks are dropped.
+
+  for (;;)
+  {
+    struct streamSlot *sl = NULL;
+
+    pthread_mutex_lock(&s.lock);
+    for (;;)
+    {
+      for (int k = 0; k < s.nSlots && sl == NULL; k++)
+        if (s.slot[k].state == SLOT_FILTERED && s.slot[k].seq == s.writeSeq)
+          sl = &s.slot[k];
+      if (sl != NULL || (s.readDone && s.writeSeq == s.readSeq) || s.failed)
+        break;
+      pthread_cond_wait(&s.cond, &s.lock);
+    }
+    pthread_mutex_unlock(&s.lock);
+    if (sl == NULL)
+      break;
+
+    if (sl->n > 0)
+    {
+      struct candFrame f = {(uint32_t)sl->n, (uint32_t)sl->nBytes};
+
+      if (fwrite(&f, sizeof(f), 1, out) != 1 || fwrite(sl->bytes, 1, sl->nBytes, out) != sl->nBytes)
+      {
+        pthread_mutex_lock(&s.lock);
+        s.failed = 1;
+        pthread_mutex_unlock(&s.lock);
+      }
+      count += sl->n;
+      bytes += sizeof(f) + sl->nBytes;
+    }
+
+    pthread_mutex_lock(&s.lock);
+    sl->state = SLOT_FREE;
+    s.writeSeq++;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+  }
+
+  // A failure anywhere stops every stage; the threads see it at their next wait.
+
+  pthread_mutex_lock(&s.lock);
+  if (s.failed)
+    s.readDone = 1;
+  pthread_cond_broadcast(&s.cond);
+  pthread_mutex_unlock(&s.lock);
+  pthread_join(reader, NULL);
+  for (int k = 0; k < started; k++)
+    pthread_join(tid[k], NULL);
+
+  // The count is only known now; it goes into the header, which is written again.
+
+  hdr.count = count;
+  ok = !s.failed && fseek(out, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, out) == 1;
+  if (fclose(out) != 0)
+    ok = 0;
+  out = NULL;
+  if (!ok)
+    fprintf(stderr, "Filtering into %s failed (%s)\n", outPath, inPath != NULL ? "broken input file, or write error" : "write error");
+
+done:
+  if (out != NULL)
+    fclose(out);
+  if (s.in != NULL)
+    fclose(s.in);
+  if (s.slot != NULL)
+    for (int k = 0; k < s.nSlots; k++)
+    {
+      free(s.slot[k].codes);
+      free(s.slot[k].bytes);
+    }
+  free(s.slot);
+  free(h);
+  if (locked)
+  {
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.cond);
+  }
+  if (!ok)
+    return -1;
+  fprintf(stdout, "%llu of %llu codes kept, %llu bytes (%.2f per code), in %.1f s with %d filter threads\n",
+          (unsigned long long)count, (unsigned long long)s.codesIn, (unsigned long long)bytes,
+          count ? (double)(bytes - sizeof(hdr)) / count : 0.0, (piTimeNow() - t0) / 1e6, started);
+  return 0;
+}
+
+/* ======================================================= */
+/* SECTION: dataset export (-X)                            */
+/* ------------------------------------------------------- */
+/* Producer threads play games against random secrets, taking the hint solver's guess every round (its cache is   */
+/* shared, so after the first few games most guesses are cache hits), and buffer one row per guess in per-column  */
+/* chunks of EXPORT_CHUNK rows. A full chunk reserves the next EXPORT_CHUNK rows of the dataset and is written    */
+/* with one pwrite per column at its own offset, so producers never wait for each other's writes and every such  */
+/* write is large and page-aligned. The partial chunks left at the end are appended by the main thread.           */
+/* See mm-dataset.h for the layout.                                                                              */
+
+enum exportColumn
+{
+  COL_GAME,
+  COL_ROUND,
+  COL_SECRET,
+  COL_GUESS,
+  COL_EXACT,
+  COL_APPROX,
+  COL_REMAINING,
+  COL_WORST,
+  COL_CLASSES,
+  EXPORT_COLUMNS
+};
+
+// (in the order of enum exportColumn)
+static const struct
+{
+  const char *name, *type;
+  int width;
+} exportColumns[EXPORT_COLUMNS] = {
+    {"game", "u32", 4}, {"round", "u8", 1}, {"secret", "u64", 8}, {"guess", "u64", 8}, {"exact", "u8", 1},
+    {"approx", "u8", 1}, {"remaining", "u32", 4}, {"worst", "u32", 4}, {"classes", "u8", 1},
+};
+
+struct exporter
+{
+  const struct codeSpace *sp;
+  const code_t *all; // the whole code space, every game starts from a copy
+  uint64_t budget;   // for the hint solver, as with -B
+  int fd[EXPORT_COLUMNS];
+  uint64_t games, nextGame, rows;
+  int failed;
+  pthread_mutex_t lock;
+};
+
+struct exportProducer
+{
+  struct exporter *ex;
+  unsigned int seed;
+  unsigned char *col[EXPORT_COLUMNS];
+  size_t n; // rows in the chunk
+};
+
+/* write @n@ rows of the chunk of @p@ as rows @start@... of the dataset */
+static void exportWrite(struct exportProducer *p, uint64_t start, size_t n)
+{
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+  {
+    size_t bytes = n * exportColumns[c].width;
+
+    if (pwrite(p->ex->fd[c], p->col[c], bytes, DATASET_HEADER_SIZE + start * exportColumns[c].width) != (ssize_t)bytes)
+      __atomic_store_n(&p->ex->failed, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/* append one row to the chunk of @p@, writing the chunk out when it is full */
+static void exportRow(struct exportProducer *p, const uint64_t *row)
+{
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+    switch (exportColumns[c].width)
+    {
+    case 1:
+      ((uint8_t *)p->col[c])[p->n] = (uint8_t)row[c];
+      break;
+    case 4:
+      ((uint32_t *)p->col[c])[p->n] = (uint32_t)row[c];
+      break;
+    default:
+      ((uint64_t *)p->col[c])[p->n] = row[c];
+    }
+  if (++p->n == EXPORT_CHUNK)
+  {
+    uint64_t start;
+
+    pthread_mutex_lock(&p->ex->lock);
+    start = p->ex->rows;
+    p->ex->rows += EXPORT_CHUNK;
+    pthread_mutex_unlock(&p->ex->lock);
+    exportWrite(p, start, EXPORT_CHUNK);
+    p->n = 0;
+  }
+}
+
+/* play game @game@ with the hint solver as codebreaker, keeping the candidates in @cands@ */
+static void exportGame(struct exportProducer *p, uint64_t game, code_t *cands)
+{
+  const struct codeSpace *sp = p->ex->sp;
+  struct histEntry h[EXPORT_MAX_ROUNDS];
+  code_t secret = sp->v->gen(&p->seed, sp->colors, sp->len);
+  size_t n = sp->size;
+  int fb = 0;
+
+  memcpy(cands, p->ex->all, n * sizeof(code_t));
+  for (int r = 0; r < EXPORT_MAX_ROUNDS && FB_EXACT(fb) != sp->len; r++)
+  {
+    unsigned int part[FB_CLASSES];
+    struct hint hint;
+    uint64_t row[EXPORT_COLUMNS];
+    int worst, classes = 0;
+
+    if (hintQuery(sp, h, r, p->ex->budget, &hint) < 0)
+    {
+      __atomic_store_n(&p->ex->failed, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    memset(part, 0, sizeof(part));
+    worst = sp->v->partition(cands, n, hint.guess, sp->len, part);
+    for (int c = 0; c < FB_CLASSES; c++)
+      classes += part[c] != 0;
+    fb = sp->v->score(secret, hint.guess, sp->len);
+    n = sp->v->filter(cands, n, hint.guess, fb, sp->len);
+    h[r].guess = hint.guess;
+    h[r].fb = fb;
+
+    row[COL_GAME] = game;
+    row[COL_ROUND] = r + 1;
+    row[COL_SECRET] = secret;
+    row[COL_GUESS] = hint.guess;
+    row[COL_EXACT] = FB_EXACT(fb);
+    row[COL_APPROX] = FB_APPROX(fb);
+    row[COL_REMAINING] = n;
+    row[COL_WORST] = worst;
+    row[COL_CLASSES] = classes;
+    exportRow(p, row);
+  }
+}
+
+static void *exportProducerLoop(void *arg)
+{
+  struct exportProducer *p = (struct exportProducer *)arg;
+  code_t *cands = (code_t *)malloc(p->ex->sp->size * sizeof(code_t));
+  uint64_t game;
+
+  if (cands == NULL)
+  {
+    __atomic_store_n(&p->ex->failed, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  while (!__atomic_load_n(&p->ex->failed, __ATOMIC_RELAXED) && (game = __atomic_fetch_add(&p->ex->nextGame, 1, __ATOMIC_RELAXED)) < p->ex->games)
+    exportGame(p, game, cands);
+  free(cands);
+  return NULL;
+}
+
+/* play @games@ games and export them as a columnar dataset into directory @dir@; returns 0 on success */
+int exportDataset(const char *dir, uint64_t games, uint64_t budget)
+{
+  struct codeSpace sp;
+  struct exporter ex;
+  struct exportProducer prod[MAX_WORKERS];
+  pthread_t tid[MAX_WORKERS];
+  int started[MAX_WORKERS];
+  int producers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t t0 = piTimeNow(), bytes = 0;
+  size_t count;
+  char path[512];
+  int ok = 0;
+
+  spaceInit(&sp, gameVariant, colors, seqlen);
+  if (sp.size > EXPORT_MAX_CODES)
+  {
+    fprintf(stderr, "The dataset export plays at most %d sequences\n", EXPORT_MAX_CODES);
+    return -1;
+  }
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", dir, strerror(errno));
+    return -1;
+  }
+
+  // Every failure below jumps to done, which releases whatever had been set up by then.
+
+  memset(&ex, 0, sizeof(ex));
+  memset(prod, 0, sizeof(prod));
+  ex.sp = &sp;
+  ex.budget = budget;
+  ex.games = games;
+  pthread_mutex_init(&ex.lock, NULL);
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+    ex.fd[c] = -1;
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+  {
+    snprintf(path, sizeof(path), "%s/%s.col", dir, exportColumns[c].name);
+    if ((ex.fd[c] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+      fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+      goto done;
+    }
+  }
+  if ((ex.all = spaceFilter(&sp, NULL, 0, &count, NULL)) == NULL)
+  {
+    fprintf(stderr, "Cannot allocate the export buffers\n");
+    goto done;
+  }
+
+  if (producers < 1)
+    producers = 1;
+  if (producers > MAX_WORKERS)
+    producers = MAX_WORKERS;
+  for (int k = 0; k < producers; k++)
+  {
+    prod[k].ex = &ex;
+    prod[k].seed = (unsigned int)time(NULL) ^ (unsigned int)getpid() ^ (unsigned int)(k * 0x9E3779B9u);
+    for (int c = 0; c < EXPORT_COLUMNS; c++)
+      if ((prod[k].col[c] = (unsigned char *)malloc((size_t)EXPORT_CHUNK * exportColumns[c].width)) == NULL)
+      {
+        fprintf(stderr, "Cannot allocate the export buffers\n");
+        goto done;
+      }
+  }
+  for (int k = 0; k < producers; k++)
+    started[k] = k > 0 && pthread_create(&tid[k], NULL, exportProducerLoop, &prod[k]) == 0;
+
+  // We are a producer as well (and stand in for any that could not be started).
+
+  for (int k = 0; k < producers; k++)
+    if (!started[k])
+      exportProducerLoop(&prod[k]);
+  for (int k = 0; k < producers; k++)
+    if (started[k])
+      pthread_join(tid[k], NULL);
+
+  // The partial chunks go at the end, one after the other; then every header gets the final number of rows.
+
+  for (int k = 0; k < producers; k++)
+  {
+    exportWrite(&prod[k], ex.rows, prod[k].n);
+    ex.rows += prod[k].n;
+  }
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+  {
+    unsigned char page[DATASET_HEADER_SIZE];
+    struct datasetHeader *hdr = (struct datasetHeader *)page;
+
+    memset(page, 0, sizeof(page));
+    hdr->magic = DATASET_MAGIC;
+    hdr->version = DATASET_VERSION;
+    strncpy(hdr->column, exportColumns[c].name, sizeof(hdr->column) - 1);
+    strncpy(hdr->type, exportColumns[c].type, sizeof(hdr->type) - 1);
+    hdr->width = exportColumns[c].width;
+    hdr->rows = ex.rows;
+    hdr->games = games;
+    strncpy(hdr->variant, sp.v->name, sizeof(hdr->variant) - 1);
+    hdr->colors = sp.colors;
+    hdr->len = sp.len;
+    if (pwrite(ex.fd[c], page, sizeof(page), 0) != (ssize_t)sizeof(page) || close(ex.fd[c]) != 0)
+      ex.failed = 1;
+    ex.fd[c] = -1;
+    bytes += DATASET_HEADER_SIZE + ex.rows * exportColumns[c].width;
+  }
+
+  if (ex.failed)
+    fprintf(stderr, "Writing the dataset into %s failed\n", dir);
+  else
+  {
+    fprintf(stdout, "%llu games, %llu guesses, %llu bytes in %d columns, in %.1f s with %d producers\n",
+            (unsigned long long)games, (unsigned long long)ex.rows, (unsigned long long)bytes, EXPORT_COLUMNS,
+            (piTimeNow() - t0) / 1e6, producers);
+    ok = 1;
+  }
+
+done:
+  for (int c = 0; c < EXPORT_COLUMNS; c++)
+    if (ex.fd[c] >= 0)
+      close(ex.fd[c]);
+  for (int k = 0; k < MAX_WORKERS; k++)
+    for (int c = 0; c < EXPORT_COLUMNS; c++)
+      free(prod[k].col[c]);
+  free((void *)ex.all);
+  pthread_mutex_destroy(&ex.lock);
+  return ok ? 0 : -1;
+}
+
+/* ======================================================= */
+/* SECTION: expected-case optimal solver (-A)              */
+/* ------------------------------------------------------- */
+/* The strategy that minimises the average number of guesses, found by depth-first branch-and-bound. The cost of a */
+/* set S of candidates is the total number of guesses needed to find every secret in S; a guess g costs |S| (every */
+/* secret pays for it) plus the cost of each of its feedback classes but the win. Costs are bounded from below by  */
+/* the best a tree could possibly do: every guess finds at most one secret and splits the rest into at most B      */
+/* classes, so at most B^(d-1) secrets can be found with the d-th guess. Adding up these bounds over the classes   */
+/* of a guess gives a bound for the guess, which orders the guesses (candidates first on a tie) and prunes every  */
+/* guess that cannot beat the best one found so far. Subproblems are memoised by their candidate set; a search    */
+/* that was cut off leaves a lower bound in the memo instead of the cost. Colours that were in no guess yet are    */
+/* interchangeable, so of the guesses that only differ in those, one is tried; at the root, where that is every   */
+/* colour, guesses that only differ in the order of the pegs are tried once as well. For classic 6x4 this finds   */
+/* the known optimum, 5625 guesses for the 1296 secrets (4.3403 on average), in about 3 minutes on one core.      */
+
+struct expMemo
+{
+  uint64_t h1, h2; // the candidate set, hashed twice
+  uint32_t n, value;
+  code_t best;     // if @exact@: the guess that achieves @value@; otherwise @value@ is only a lower bound
+  int exact;
+};
+
+struct expSolver
+{
+  const struct codeSpace *sp;
+  code_t *pool;     // every code, as guesses
+  uint32_t *lb;     // lb[n]: lower bound on the cost of any set of n candidates
+  int win;          // feedback class of a win
+  struct expMemo *memo;
+  uint64_t nodes, hits;
+  int failed;       // an allocation failed: every search returns at once, and nothing more is memoised
+};
+
+struct expGuess
+{
+  uint32_t lb;
+  int cand;
+  code_t g;
+};
+
+static int expGuessOrder(const void *a, const void *b)
+{
+  const struct expGuess *x = (const struct expGuess *)a, *y = (const struct expGuess *)b;
+
+  if (x->lb != y->lb)
+    return x->lb < y->lb ? -1 : 1;
+  return y->cand - x->cand;
+}
+
+static struct expMemo *expLookup(struct expSolver *es, const code_t *codes, uint32_t n, uint64_t *h1, uint64_t *h2)
+{
+  uint64_t a = 0x9E3779B97F4A7C15ull, b = n;
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    a = mix64(a ^ codes[i]);
+    b = b * 0x100000001B3ull + mix64(codes[i] + 0x632BE59BD9B4E019ull);
+  }
+  *h1 = a;
+  *h2 = b;
+  return &es->memo[a & (EXPSOLVE_MEMO - 1)];
+}
+
+/* the multiplicities of the colours of @g@, sorted, and its number of blanks: the same for all guesses that are */
+/* equivalent up to renaming colours and reordering pegs                                                          */
+static uint64_t expPattern(code_t g, int len)
+{
+  int mult[16] = {0}, blanks = 0;
+  uint64_t key = 0;
+
+  for (int i = 0; i < len; i++)
+    if (PEG(g, i) == 0)
+      blanks++;
+    else
+      mult[PEG(g, i)]++;
+  for (int k = len; k >= 1; k--)
+    for (int c = 1; c < 16; c++)
+      if (mult[c] == k)
+        key = key * 16 + k;
+  return key * 16 + blanks;
+}
+
+/* whether @g@ is the first of the guesses that only differ from it by renaming colours that were in no guess so far */
+/* (@used@): those colours are interchangeable, so the candidates are the same and so is the cost                     */
+static int expCanonical(code_t g, int len, int colors, unsigned int used)
+{
+  unsigned int seen = used | 1;
+  int next = 1;
+
+  for (int i = 0; i < len; i++)
+  {
+    int c = PEG(g, i);
+
+    if ((seen >> c) & 1)
+      continue;
+    while (next <= colors && ((seen >> next) & 1))
+      next++;
+    if (c != next)
+      return 0;
+    seen |= 1u << c;
+  }
+  return 1;
+}
+
+/* the cost of finding every secret of @codes@ (@n@ of them, in rank order) if it is below @beta@; otherwise some */
+/* value of at least @beta@. @used@ are the colours guessed on the way here. Out of memory, it sets @es->failed@  */
+/* and returns @beta@, which cuts off every search above it.                                                      */
+static uint32_t expSolve(struct expSolver *es, const code_t *codes, uint32_t n, uint32_t beta, int depth,
+                         unsigned int used)
+{
+  const struct variant *v = es->sp->v;
+  int len = es->sp->len;
+  unsigned int part[FB_CLASSES];
+  uint8_t *cls;
+  struct expGuess *guesses;
+  struct expMemo *m;
+  uint64_t h1, h2, *seen = NULL;
+  uint32_t best = beta, nGuesses = 0, nSeen = 0;
+  code_t bestGuess = 0;
+  int found = 0;
+
+  if (n == 1)
+    return 1;
+  if (n == 2)
+    return 3;
+  if (es->failed)
+    return beta;
+
+  m = expLookup(es, codes, n, &h1, &h2);
+  if (m->h1 == h1 && m->h2 == h2 && m->n == n)
+  {
+    es->hits++;
+    if (m->exact || m->value >= beta)
+      return m->value;
+  }
+  es->nodes++;
+
+  memset(part, 0, sizeof(part));
+  cls = (uint8_t *)malloc(n);
+  guesses = (struct expGuess *)malloc(es->sp->size * sizeof(struct expGuess));
+  if (depth == 0)
+    seen = (uint64_t *)malloc(es->sp->size * sizeof(uint64_t));
+  if (cls == NULL || guesses == NULL || (depth == 0 && seen == NULL))
+  {
+    free(cls);
+    free(guesses);
+    free(seen);
+    es->failed = 1;
+    return beta;
+  }
+
+  // The bound of every guess; we reset @part@ as we add up the classes. The candidates come first (then the rest of
+  // the codes), as they are the likeliest to reach the bound for the whole set, which ends the search at once.
+
+  for (uint64_t k = 0, ci = 0; k < n + es->sp->size; k++)
+  {
+    code_t g = k < n ? codes[k] : es->pool[k - n];
+    uint32_t lb = n, classes = 0, small = 1;
+    int cand;
+
+    if (k >= n && ci < n && codes[ci] == g)
+    {
+      ci++;
+      continue;
+    }
+    if (!expCanonical(g, len, es->sp->colors, used))
+      continue;
+    if (depth == 0)
+    {
+      uint64_t key = expPattern(g, len);
+      uint32_t j;
+
+      for (j = 0; j < nSeen && seen[j] != key; j++)
+        ;
+      if (j < nSeen)
+        continue;
+      seen[nSeen++] = key;
+    }
+
+    v->classify(codes, n, g, len, cls, part);
+    cand = part[es->win] != 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      unsigned int c = part[cls[i]];
+
+      if (c == 0)
+        continue;
+      part[cls[i]] = 0;
+      classes++;
+      if (cls[i] != es->win)
+      {
+        lb += es->lb[c];
+        small &= c <= 2;
+      }
+    }
+
+    // A guess that does not split the candidates only wastes a guess; one whose bound is out of the budget is of no
+    // use either.
+
+    if ((classes == 1 && !cand) || lb >= beta)
+      continue;
+
+    // With no class of more than 2, the bound is the cost; if a guess also reaches the bound for any set of this
+    // size, nothing can beat it.
+
+    if (small && lb == es->lb[n])
+    {
+      best = lb;
+      bestGuess = g;
+      found = 1;
+      nGuesses = 0;
+      break;
+    }
+    guesses[nGuesses].lb = lb;
+    guesses[nGuesses].cand = cand;
+    guesses[nGuesses].g = g;
+    nGuesses++;
+  }
+  qsort(guesses, nGuesses, sizeof(struct expGuess), expGuessOrder);
+
+  // Exact costs, best bound first: the classes are solved largest first, each with what is left of the budget, and
+  // a guess is dropped as soon as its cost so far plus the bounds of the classes still to solve reaches the best.
+
+  for (uint32_t k = 0; k < nGuesses && guesses[k].lb < best; k++)
+  {
+    code_t g = guesses[k].g, *child = (code_t *)malloc(n * sizeof(code_t));
+    uint32_t start[FB_CLASSES], size[FB_CLASSES], order[FB_CLASSES], nClasses = 0, total = n, rest = guesses[k].lb - n;
+    int cut = 0;
+
+    if (child == NULL)
+    {
+      es->failed = 1;
+      break;
+    }
+    v->classify(codes, n, g, len, cls, part);
+    for (int c = 0, at = 0; c < FB_CLASSES; c++)
+    {
+      start[c] = at;
+      size[c] = part[c];
+      at += part[c];
+      if (part[c] && c != es->win)
+        order[nClasses++] = c;
+      part[c] = 0;
+    }
+    for (uint32_t i = 0; i < n; i++)
+      child[start[cls[i]]++] = codes[i];
+    for (int c = 0; c < FB_CLASSES; c++)
+      start[c] -= size[c];
+    for (uint32_t i = 1; i < nClasses; i++)
+      for (uint32_t j = i; j > 0 && size[order[j]] > size[order[j - 1]]; j--)
+      {
+        uint32_t t = order[j];
+
+        order[j] = order[j - 1];
+        order[j - 1] = t;
+      }
+
+    for (uint32_t i = 0; i < nClasses && !cut; i++)
+    {
+      int c = order[i];
+
+      rest -= es->lb[size[c]];
+      total += expSolve(es, child + start[c], size[c], best - total - rest, depth + 1, used | colourMask(g, len));
+      cut = total + rest >= best;
+    }
+    free(child);
+    if (!cut)
+    {
+      best = total;
+      bestGuess = g;
+      found = 1;
+      if (best == es->lb[n])
+        break;
+    }
+  }
+
+  free(cls);
+  free(guesses);
+  free(seen);
+  if (es->failed)
+    return beta;
+
+  m->h1 = h1;
+  m->h2 = h2;
+  m->n = n;
+  m->value = best;
+  m->best = bestGuess;
+  m->exact = found;
+  return best;
+}
+
+/* the best guess for @codes@, solving the set again if the memo lost it */
+static code_t expBest(struct expSolver *es, const code_t *codes, uint32_t n, int depth, unsigned int used)
+{
+  struct expMemo *m;
+  uint64_t h1, h2;
+
+  if (n <= 2)
+    return codes[0];
+  m = expLookup(es, codes, n, &h1, &h2);
+  if (!(m->h1 == h1 && m->h2 == h2 && m->n == n && m->exact))
+  {
+    expSolve(es, codes, n, UINT32_MAX, depth, used);
+    m = expLookup(es, codes, n, &h1, &h2);
+  }
+  return es->failed ? codes[0] : m->best;
+}
+
+/* print the strategy for @codes@ as a tree: one line per guess, indented by depth, after the feedback leading to it */
+static void expTree(struct expSolver *es, const code_t *codes, uint32_t n, int depth, int fb, unsigned int used)
+{
+  code_t g = expBest(es, codes, n, depth, used), *child;
+  unsigned int part[FB_CLASSES];
+  uint32_t start[FB_CLASSES];
+  uint8_t *cls;
+
+  if (es->failed)
+    return;
+  fprintf(stdout, "%*s", 2 * depth, "");
+  if (depth > 0)
+    fprintf(stdout, "%d/%d: ", FB_EXACT(fb), FB_APPROX(fb));
+  for (int i = 0; i < es->sp->len; i++)
+    fprintf(stdout, "%x", PEG(g, i));
+  fprintf(stdout, " (%u)\n", n);
+  if (n == 1)
+    return;
+
+  cls = (uint8_t *)malloc(n);
+  child = (code_t *)malloc(n * sizeof(code_t));
+  if (cls == NULL || child == NULL)
+  {
+    free(cls);
+    free(child);
+    es->failed = 1;
+    return;
+  }
+  memset(part, 0, sizeof(part));
+  es->sp->v->classify(codes, n, g, es->sp->len, cls, part);
+  for (int c = 0, at = 0; c < FB_CLASSES; c++)
+  {
+    start[c] = at;
+    at += part[c];
+  }
+  for (uint32_t i = 0; i < n; i++)
+    child[start[cls[i]]++] = codes[i];
+  for (int c = 0; c < FB_CLASSES; c++)
+    if (part[c] && c != es->win)
+      expTree(es, child + start[c] - part[c], part[c], depth + 1, c, used | colourMask(g, es->sp->len));
+  free(child);
+  free(cls);
+}
+
+/* find the strategy with the fewest guesses on average for the configuration of the game, and print it; returns */
+/* 0 on success                                                                                                   */
+int expectedSolve(void)
+{
+  struct codeSpace sp;
+  struct expSolver es;
+  size_t count;
+  uint64_t t0 = piTimeNow(), capacity = 1, filled = 0;
+  uint32_t cost, branches, level = 1;
+  int ok = 0;
+
+  spaceInit(&sp, gameVariant, colors, seqlen);
+  if (sp.size > EXPSOLVE_MAX_CODES)
+  {
+    fprintf(stderr, "The expected-case solver plays at most %d sequences\n", EXPSOLVE_MAX_CODES);
+    return -1;
+  }
+  memset(&es, 0, sizeof(es));
+  es.sp = &sp;
+  es.win = FB(sp.len, 0);
+  es.pool = spaceFilter(&sp, NULL, 0, &count, NULL);
+  es.memo = (struct expMemo *)calloc(EXPSOLVE_MEMO, sizeof(struct expMemo));
+  es.lb = (uint32_t *)malloc((sp.size + 1) * sizeof(uint32_t));
+  if (es.pool == NULL || es.memo == NULL || es.lb == NULL)
+    goto done;
+
+  // The bound: (len+1)(len+2)/2 feedbacks have exact + approx <= len; all pegs but one exact with the last one only
+  // approximate is impossible, and the win ends the game, which leaves B branches. The d-th guess can find at most
+  // B^(d-1) secrets, and the bound for n secrets fills the levels in turn.
+
+  branches = (uint32_t)((sp.len + 1) * (sp.len + 2) / 2 - 2);
+  if (branches < 1)
+    branches = 1;
+  es.lb[0] = 0;
+  for (uint64_t n = 1; n <= sp.size; n++)
+  {
+    if (filled == capacity)
+    {
+      level++;
+      filled = 0;
+      capacity = capacity * branches > sp.size ? sp.size : capacity * branches;
+    }
+    filled++;
+    es.lb[n] = es.lb[n - 1] + level;
+  }
+
+  cost = expSolve(&es, es.pool, (uint32_t)sp.size, UINT32_MAX, 0, 0);
+  if (es.failed)
+    goto done;
+  fprintf(stdout, "Optimal expected number of guesses for %s %dx%d: %u/%llu = %.4f (%llu nodes searched, %llu memo hits, "
+                  "%.1f s)\n",
+          sp.v->name, sp.colors, sp.len, cost, (unsigned long long)sp.size, (double)cost / sp.size,
+          (unsigned long long)es.nodes, (unsigned long long)es.hits, (piTimeNow() - t0) / 1e6);
+  expTree(&es, es.pool, (uint32_t)sp.size, 0, 0, 0);
+  ok = !es.failed;
+
+done:
+  free(es.pool);
+  free(es.lb);
+  free(es.memo);
+  if (!ok)
+  {
+    fprintf(stderr, "The expected-case solver ran out of memory\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* ======================================================= */
+/* SECTION: aux functions for game logic                   */
+/* ------------------------------------------------------- */
+
+/* interface on top of the low-level pin I/O code */
+
+/* blink the led on pin @led@, @c@ times */
+void blinkN(uint32_t *gpio, int led, int c)
+{
+
+  // This method is responsible for blinking either of the leds (red or green) depending on the argument passed (the
+  // corresponding argument is int led) for n number of times based on the argument passed (the corresponding argument is
+  // int c).
+
+  // For instance, if we want to make the red LED blink twice, we'd call this method as blinkN(gpio, 5, 2) as 5 is the PIN
+  // number of the red LED and 2 as we want it to blink twice.
+
+  for (int i = 0; i < c; i++)
+  {
+
+    // We turn the LED on by setting our desired PIN to HIGH using our writeLED method.
+
+    writeLED(gpio, led, HIGH);
+
+    // We've added some delay before the next blink to avoid it from blinking too fast and to execute our program flow
+    // at a healthy pace.
+
+    delayMicroseconds(200 * 1000);
+
+    // We turn the LED off by setting our desired PIN to LOW using our writeLED method.
+
+    writeLED(gpio, led, LOW);
+
+    // We've added some delay before the next blink to avoid it from blinking too fast and to execute our program flow
+    // at a healthy pace.
+
+    delayMicroseconds(200 * 1000);
+    // This proccess ensues until the method has finished iterating completely.
+  }
+}
+
+/* ======================================================= */
+/* SECTION: live telemetry                                 */
+/* ------------------------------------------------------- */
+/* the state of every station is published in a shared memory block (see mm-telemetry.h), for mm-telemetry   */
+/* and other monitors; it is created once at start-up, after that the game only does plain stores into it    */
+
+static struct telemetryBlock *telemetry = NULL;
+static char telemetryName[64];
+
+static void telemetryClose(void)
+{
+  if (telemetry == NULL)
+    return;
+  munmap(telemetry, sizeof(struct telemetryBlock));
+  shm_unlink(telemetryName);
+  telemetry = NULL;
+}
+
+/* create the telemetry block of this process for @stations@ stations; without it, the game runs all the same */
+int telemetryOpen(int stations)
+{
+  int fd;
+
+  snprintf(telemetryName, sizeof(telemetryName), "%s%d", TELEMETRY_PREFIX, (int)getpid());
+  if ((fd = shm_open(telemetryName, O_CREAT | O_RDWR | O_TRUNC, 0644)) < 0)
+    return failure(FALSE, "telemetry: shm_open failed: %s\n", strerror(errno));
+  if (ftruncate(fd, sizeof(struct telemetryBlock)) != 0)
+  {
+    close(fd);
+    shm_unlink(telemetryName);
+    return failure(FALSE, "telemetry: ftruncate failed: %s\n", strerror(errno));
+  }
+  telemetry = (struct telemetryBlock *)mmap(NULL, sizeof(struct telemetryBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (telemetry == MAP_FAILED)
+  {
+    telemetry = NULL;
+    shm_unlink(telemetryName);
+    return failure(FALSE, "telemetry: mmap failed: %s\n", strerror(errno));
+  }
+
+  telemetry->pid = (int32_t)getpid();
+  telemetry->stations = stations < TELEMETRY_STATIONS ? stations : TELEMETRY_STATIONS;
+  telemetry->started = piTimeNow();
+  for (int i = 0; i < TELEMETRY_STATIONS; i++)
+    telemetry->station[i].lastExact = telemetry->station[i].lastApprox = -1;
+  telemetry->version = TELEMETRY_VERSION;
+  __atomic_store_n(&telemetry->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+  atexit(telemetryClose);
+  return 0;
+}
+
+/* ======================================================= */
+/* SECTION: game session                                   */
+/* ------------------------------------------------------- */
+/* the games, played on hardware that has been set up once */
+
+/* the pins of each station; station 1 uses the pins of the CW spec */
+static const struct stationPins
+{
+  int led, led2, button;
+} stationPins[MAX_STATIONS] = {{LED, LED2, BUTTON}, {6, 12, 16}, {20, 21, 26}, {17, 4, 18}};
+
+/* map the GPIO and timer registers and set the pin modes of @stations@ stations; done once per process */
+int setupHardware(int stations)
+{
+  int fd;
+
+  // -----------------------------------------------------------------------------
+  // constants for RPi2
+  gpiobase = 0x3F200000;
+  timebase = 0x3F003000;
+  // -----------------------------------------------------------------------------
+  // memory mapping
+  // Open the master /dev/memory device
+
+  if ((fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
+    return failure(FALSE, "setup: Unable to open /dev/mem: %s\n", strerror(errno));
+
+  // GPIO:
+  gpio = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, gpiobase);
+  if ((int32_t)gpio == -1)
+    return failure(FALSE, "setup: mmap (GPIO) failed: %s\n", strerror(errno));
+
+  piTime = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, timebase);
+  if (piTime == MAP_FAILED)
+  {
+    piTime = NULL;
+    return failure(FALSE, "setup: mmap (timer) failed: %s\n", strerror(errno));
+  }
+
+  // With the timer mapped we can find out how much nanosleep overshoots, which decides when delays spin instead.
+
+  calibrateDelay();
+
+  // We set up the modes of our hardwares as follows.
+
+  // Since our LEDs emit light, we set them to OUTPUT and as users enter values through the button, we set that to INPUT.
+
+  for (int i = 0; i < stations; i++)
+  {
+    pinMode(gpio, stationPins[i].led, OUTPUT);
+    pinMode(gpio, stationPins[i].led2, OUTPUT);
+    pinMode(gpio, stationPins[i].button, INPUT);
+  }
+
+  return 0;
+}
+
+/* the settings shared by all stations */
+static struct
+{
+  int stations, games, debug, hints, fixedSecret;
+  int evil; // no secret: every guess gets the feedback that keeps the most secrets possible (-E)
+  uint64_t hintBudget; // in us; 0 for an exact hint however long it takes
+  uint32_t samplePeriod; // time between button samples, in us
+  int realtime, rtCpu;   // run the sampling thread in real-time mode (-R), on this CPU
+  const struct feedbackProtocol *feedback; // how the LEDs talk to the player (-F)
+  uint32_t unit;                           // time unit of the fast protocol, in us
+  int fixedWindow;                         // a digit ends TIMEOUT after its first press (-W fixed)
+  uint64_t windowMin, windowMax;           // otherwise: bounds of the adaptive window, in us
+} session;
+
+// set by the first SIGINT or SIGTERM; the event loop stops at its next scan
+static volatile sig_atomic_t stopRequested = 0;
+
+/* SIGINT and SIGTERM (the usual end of kiosk play with -g 0): the first one stops the games, so that the process */
+/* ends normally and the reports registered with atexit() (jitter, telemetry) run; a second one ends it at once,  */
+/* removing the telemetry block first (shm_unlink() only unlinks a file, which is safe in a signal handler)       */
+static void stopSignal(int sig)
+{
+  if (stopRequested)
+  {
+    if (telemetry != NULL)
+      shm_unlink(telemetryName);
+    signal(sig, SIG_DFL);
+    raise(sig);
+  }
+  stopRequested = 1;
+}
+
+/* install stopSignal() for SIGINT and SIGTERM; without SA_RESTART, so that it also ends a wait for ENTER */
+void catchStopSignals(void)
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stopSignal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+}
+
+/* print hint @h@ for the rounds played so far (-H); @failed@ if it could not be computed */
+static void printHint(const struct hint *h, int failed)
+{
+  int seq[16];
+
+  if (failed)
+  {
+    logMsg(LOG_OUT, stdout, "Hint: not enough memory to compute one\n");
+    return;
+  }
+  unpackSeq(h->guess, seq, seqlen);
+
+  logMsg(LOG_OUT, stdout, "Hint: %s%llu sequences still possible, try:", h->cut ? "at most " : "",
+         (unsigned long long)h->remaining);
+  for (int i = 0; i < seqlen; i++)
+    logMsg(LOG_OUT, stdout, " %d", seq[i]);
+  logMsg(LOG_OUT, stdout, " (at most %d left afterwards)\n", h->worst);
+  if (h->cut)
+    logMsg(LOG_VERBOSE, stdout, "Hint: the time budget ran out while the candidates were still being filtered\n");
+  else if (!h->complete)
+    logMsg(LOG_VERBOSE, stdout, "Hint: search cut off by the time budget after %.1f%% of the guesses\n", 100.0 * h->coverage);
+}
+
+/* compute and show the hint for the rounds played so far, here and now */
+void showHint(const struct histEntry *hist, int rounds)
+{
+  struct codeSpace sp;
+  struct hint h;
+  int failed;
+
+  spaceInit(&sp, gameVariant, colors, seqlen);
+  failed = hintQuery(&sp, hist, rounds, session.hintBudget, &h) < 0;
+  printHint(&h, failed);
+}
+
+/* the hint worker: computes the hints of all stations in the background, so that a slow hint (an exact one, or a */
+/* large code space) never holds up the event loop. A station posts its history and goes on; the hint is printed  */
+/* by the event loop once it is ready. A newer request of a station replaces one not yet started, and the answer  */
+/* to an older one is dropped, as is one that arrives after the station played on (or its game is over).         */
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int running, stop, busy;
+  struct hintRequest
+  {
+    struct histEntry *hist; // the history to answer (NULL when there is none waiting)
+    int rounds, game;       // its length, and the game it belongs to
+    int ready, failed;      // an answer is waiting in @result@
+    int resultRounds, resultGame;
+    struct hint result;
+  } req[MAX_STATIONS];
+} hintWorker = {.lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
+static void *hintWorkerLoop(void *arg)
+{
+  struct codeSpace sp;
+
+  (void)arg;
+  spaceInit(&sp, gameVariant, colors, seqlen);
+
+  pthread_mutex_lock(&hintWorker.lock);
+  while (!hintWorker.stop)
+  {
+    struct hintRequest *r = NULL;
+    struct histEntry *hist;
+    struct hint h;
+    int rounds, game, failed;
+
+    for (int i = 0; i < MAX_STATIONS && r == NULL; i++)
+      if (hintWorker.req[i].hist != NULL)
+        r = &hintWorker.req[i];
+    if (r == NULL)
+    {
+      pthread_cond_wait(&hintWorker.cond, &hintWorker.lock);
+      continue;
+    }
+
+    // The request is ours now; while we work on it, the station may post a newer one.
+
+    hist = r->hist;
+    rounds = r->rounds;
+    game = r->game;
+    r->hist = NULL;
+    hintWorker.busy = 1;
+    pthread_mutex_unlock(&hintWorker.lock);
+    failed = hintQuery(&sp, hist, rounds, session.hintBudget, &h) < 0;
+    free(hist);
+    pthread_mutex_lock(&hintWorker.lock);
+    hintWorker.busy = 0;
+    if (r->hist == NULL)
+    {
+      r->result = h;
+      r->failed = failed;
+      r->resultRounds = rounds;
+      r->resultGame = game;
+      r->ready = 1;
+    }
+  }
+  pthread_mutex_unlock(&hintWorker.lock);
+  return NULL;
+}
+
+void startHintWorker(void)
+{
+  if (pthread_create(&hintWorker.thread, NULL, hintWorkerLoop, NULL) == 0)
+    hintWorker.running = 1;
+}
+
+/* stop the hint worker; one still busy with a hint is left to finish on its own, as that may take long */
+void stopHintWorker(void)
+{
+  int busy;
+
+  if (!hintWorker.running)
+    return;
+  pthread_mutex_lock(&hintWorker.lock);
+  hintWorker.stop = 1;
+  busy = hintWorker.busy;
+  pthread_cond_broadcast(&hintWorker.cond);
+  pthread_mutex_unlock(&hintWorker.lock);
+  if (busy)
+    pthread_detach(hintWorker.thread);
+  else
+    pthread_join(hintWorker.thread, NULL);
+  hintWorker.running = 0;
+}
+
+/* ask the worker for the hint of station @id@ after @rounds@ rounds of its game @game@; returns -1 if it cannot */
+/* take the request (it does not run, or memory ran out), so that the hint has to be computed here               */
+int requestHint(int id, const struct histEntry *hist, int rounds, int game)
+{
+  struct hintRequest *r = &hintWorker.req[id];
+  struct histEntry *copy;
+
+  if (!hintWorker.running || (copy = (struct histEntry *)malloc(rounds * sizeof(struct histEntry))) == NULL)
+    return -1;
+  memcpy(copy, hist, rounds * sizeof(struct histEntry));
+  pthread_mutex_lock(&hintWorker.lock);
+  free(r->hist);
+  r->hist = copy;
+  r->rounds = rounds;
+  r->game = game;
+  r->ready = 0;
+  pthread_cond_broadcast(&hintWorker.cond);
+  pthread_mutex_unlock(&hintWorker.lock);
+  return 0;
+}
+
+/* take the answer to the latest hint request of station @id@ if it is ready and still for the @rounds@ rounds    */
+/* played so far of game @game@: returns 1 and fills @h@ and @failed@ then, 0 otherwise                          */
+int takeHint(int id, int game, int rounds, struct hint *h, int *failed)
+{
+  struct hintRequest *r = &hintWorker.req[id];
+  int got = 0;
+
+  if (!hintWorker.running)
+    return 0;
+  pthread_mutex_lock(&hintWorker.lock);
+  if (r->ready)
+  {
+    r->ready = 0;
+    if (r->resultGame == game && r->resultRounds == rounds)
+    {
+      *h = r->result;
+      *failed = r->failed;
+      got = 1;
+    }
+  }
+  pthread_mutex_unlock(&hintWorker.lock);
+  return got;
+}
+
+/* ------------------------------------------------------- */
+/* stations: every station is an independent game on its own LEDs and button, written as a state machine that */
+/* never blocks. One event loop scans all buttons with a single GPLEV0 read and advances every station.        */
+
+// (keep in the order of TELEMETRY_STATE_NAMES in mm-telemetry.h)
+enum stationState
+{
+  ST_ROUND,       // start a new round (attempt)
+  ST_DIGIT_START, // prompt for the next digit
+  ST_DIGIT_WAIT,  // waiting for the first press of a digit
+  ST_DIGIT_COUNT, // counting presses until the digit times out
+  ST_INPUT_DONE,  // all digits entered
+  ST_SCORE,       // score the guess and show the feedback
+  ST_WON,         // the secret was found
+  ST_GAME_OVER,   // start the next game, or stop
+  ST_OUTPUT,      // playing the LED steps queued, then continue in @resume@
+  ST_DONE         // all games played
+};
+
+/* one step of LED output: show the green and red LED at brightness @level@ (0 to PWM_LEVELS), then hold for @hold@ us */
+struct ledStep
+{
+  uint8_t level[2];
+  uint32_t hold;
+};
+
+struct station
+{
+  int id;
+  struct stationPins pins;
+  enum stationState state, resume;
+  uint64_t deadline;  // end of the current LED step, or of the current digit
+
+  int secret[16], guess[16];
+  int digit, count, attempts, gamesPlayed;
+  int lastExact, lastApprox;
+  uint64_t roundStart, lastRoundTime;
+  uint64_t gameOver;  // when the last game ended, until the next one takes its first digit (0 otherwise)
+  uint64_t lastPress; // time of the last press of the digit being entered
+  uint64_t cadence;   // the player's usual gap between presses, in us (0 until the first gap was seen)
+  uint64_t window;    // how long the digit being entered stays open after its last press
+  uint64_t lastWindow;
+
+  struct ledStep steps[STATION_STEPS];
+  int nSteps, curStep;
+  int dropped;   // steps that did not fit into @steps@ since it was last played out
+  int level[2];  // brightness of the green and red LED now
+  int lit[2];    // whether the pins are high right now (PWM)
+  int queued[2]; // brightness after the last step queued
+
+  struct histEntry *hist;
+  int rounds, histCap;
+
+  code_t *cands; // evil codemaker: the secrets still possible, and the feedback class of each for the last guess
+  uint8_t *cls;
+  size_t nCands;
+};
+
+/* queue a step showing the green LED at brightness @green@ and the red one at @red@ for @hold@ us */
+static void queueLevels(struct station *st, int green, int red, uint32_t hold)
+{
+  // A full queue drops the step; that is reported once, as the player then sees less feedback than was meant.
+
+  if (st->nSteps == STATION_STEPS)
+  {
+    if (st->dropped++ == 0)
+      logMsg(LOG_OUT, stderr, "Station %d: more than %d LED steps queued, the rest of the feedback is not shown\n",
+             st->id + 1, STATION_STEPS);
+    return;
+  }
+  st->steps[st->nSteps].level[0] = green;
+  st->steps[st->nSteps].level[1] = red;
+  st->steps[st->nSteps].hold = hold;
+  st->nSteps++;
+  st->queued[0] = green;
+  st->queued[1] = red;
+}
+
+/* queue a step changing LED @which@ (0 green, 1 red) to brightness @level@, the other one stays as it is */
+static void queueStep(struct station *st, int which, int level, uint32_t hold)
+{
+  if (which == 0)
+    queueLevels(st, level, st->queued[1], hold);
+  else
+    queueLevels(st, st->queued[0], level, hold);
+}
+
+/* queue a pause of @hold@ us, the LEDs staying as they are */
+static void queuePause(struct station *st, uint32_t hold)
+{
+  queueLevels(st, st->queued[0], st->queued[1], hold);
+}
+
+/* the non-blocking counterpart of blinkN(): queue @c@ blinks of LED @which@ */
+static void queueBlink(struct station *st, int which, int c)
+{
+  for (int i = 0; i < c; i++)
+  {
+    queueStep(st, which, PWM_LEVELS, 200 * 1000);
+    queueStep(st, which, 0, 200 * 1000);
+  }
+}
+
+/* play the queued LED steps, then continue in state @next@ */
+static void startOutput(struct station *st, enum stationState next, uint64_t now)
+{
+  st->resume = next;
+  st->curStep = 0;
+  st->deadline = now;
+  st->state = ST_OUTPUT;
+}
+
+/* LED writes go through here, so that the self-test can record them instead */
+static void gpioLedOut(int pin, int value)
+{
+  writeLED(gpio, pin, value);
+}
+
+static void (*ledOut)(int pin, int value) = gpioLedOut;
+
+/* software PWM: called every SCAN_PERIOD, switches each LED on for the first level/PWM_LEVELS of every PWM_PERIOD; */
+/* the pins are only written when they change                                                                   */
+static void stationLeds(struct station *st, uint64_t now)
+{
+  int phase = (int)(now % PWM_PERIOD) * PWM_LEVELS / PWM_PERIOD;
+
+  for (int k = 0; k < 2; k++)
+  {
+    int on = st->level[k] > phase;
+
+    if (on != st->lit[k])
+    {
+      ledOut(k == 0 ? st->pins.led : st->pins.led2, on ? HIGH : LOW);
+      st->lit[k] = on;
+    }
+  }
+}
+
+/* ------------------------------------------------------- */
+/* feedback protocols: how a station tells the player what happened. "blink" is the protocol of the coursework: one */
+/* LED at a time, full brightness, counts as numbers of blinks with long pauses. "fast" drives both LEDs at once and */
+/* counts in dim (1) and bright (2) pulses, so that a feedback of up to 5 exact and 5 approximate matches takes at  */
+/* most 3 pulses: with the default unit of 80 ms, any feedback for 3 pegs is over within half a second.            */
+
+struct feedbackProtocol
+{
+  const char *name;
+  void (*round)(struct station *st);                         // a new round (not the first) starts
+  void (*digit)(struct station *st, int count);              // a digit was entered with @count@ presses
+  void (*inputDone)(struct station *st);                     // all digits entered
+  void (*score)(struct station *st, int exact, int approx);  // the feedback; the game is won if @exact@ == seqlen
+  void (*won)(struct station *st);                           // end of the game
+};
+
+static void blinkRound(struct station *st)
+{
+  // According to the Game Functionality section from the coursework specs, the red control LED should blink three
+  // times to indicate the start of a new round.
+
+  queueBlink(st, 1, 3);
+}
+
+static void blinkDigit(struct station *st, int count)
+{
+  // We acknowledge the input with a pause, the red LED once, and the green LED as many times as the button was
+  // pressed.
+
+  queuePause(st, 1000000);
+  queueBlink(st, 1, 1);
+  queueBlink(st, 0, count);
+}
+
+static void blinkInputDone(struct station *st)
+{
+  // Once all values have been entered and echoed, the red control LED is blinked twice to indicate the end of the input.
+
+  queuePause(st, 2000000);
+  queueBlink(st, 1, 2);
+}
+
+static void blinkScore(struct station *st, int exact, int approx)
+{
+  // The feedback is the green LED blinking the number of exact matches, the red LED once as a separator, and the
+  // green LED blinking the number of approximate matches, each followed by a pause. Nothing is shown for 0 matches.
+
+  if (exact != 0 || approx != 0)
+  {
+    queueBlink(st, 0, exact);
+    queuePause(st, 1000000);
+    queueBlink(st, 1, 1);
+    queuePause(st, 1000000);
+    queueBlink(st, 0, approx);
+    queuePause(st, 1000000);
+  }
+  if (exact == seqlen)
+    queuePause(st, 500000);
+}
+
+static void blinkWon(struct station *st)
+{
+  // We make the green LED blink three times while the red LED is turned on in order to represent the end of the game.
+
+  queueStep(st, 1, PWM_LEVELS, 0);
+  queueBlink(st, 0, 3);
+  queueStep(st, 1, 0, 0);
+}
+
+/* brightness of pulse @i@ when counting to @c@ in bright (2) and dim (1) pulses */
+static int fastPulse(int c, int i)
+{
+  if (i < c / 2)
+    return PWM_LEVELS;
+  if (i == c / 2 && c % 2)
+    return PWM_DIM;
+  return 0;
+}
+
+/* queue @green@ on the green and @red@ on the red LED at the same time, as pulses of one unit with a unit off */
+static void fastPulses(struct station *st, int green, int red)
+{
+  int n = (green > red ? green + 1 : red + 1) / 2;
+
+  for (int i = 0; i < n; i++)
+  {
+    queueLevels(st, fastPulse(green, i), fastPulse(red, i), session.unit);
+    queueLevels(st, 0, 0, session.unit);
+  }
+}
+
+static void fastRound(struct station *st)
+{
+  queueLevels(st, 0, PWM_LEVELS, session.unit);
+  queueLevels(st, 0, 0, session.unit);
+}
+
+static void fastDigit(struct station *st, int count)
+{
+  fastPulses(st, count, 0);
+  queuePause(st, session.unit);
+}
+
+static void fastInputDone(struct station *st)
+{
+  queueLevels(st, PWM_DIM, PWM_DIM, session.unit);
+  queueLevels(st, 0, 0, session.unit);
+}
+
+static void fastScore(struct station *st, int exact, int approx)
+{
+  fastPulses(st, exact, approx);
+  queuePause(st, session.unit);
+}
+
+static void fastWon(struct station *st)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    queueLevels(st, PWM_LEVELS, PWM_LEVELS, session.unit);
+    queueLevels(st, 0, 0, session.unit);
+  }
+}
+
+static const struct feedbackProtocol feedbackProtocols[] = {
+    {"blink", blinkRound, blinkDigit, blinkInputDone, blinkScore, blinkWon},
+    {"fast", fastRound, fastDigit, fastInputDone, fastScore, fastWon},
+};
+
+/* the protocol called @name@, or NULL */
+static const struct feedbackProtocol *findFeedback(const char *name)
+{
+  for (size_t i = 0; i < sizeof(feedbackProtocols) / sizeof(feedbackProtocols[0]); i++)
+    if (strcmp(feedbackProtocols[i].name, name) == 0)
+      return &feedbackProtocols[i];
+  return NULL;
+}
+
+/* with several stations, every line of output says which station it belongs to */
+static void stationTag(struct station *st)
+{
+  if (session.stations > 1)
+    logMsg(LOG_OUT, stdout, "[station %d] ", st->id + 1);
+}
+
+/* the evil codemaker (-E) starts every game with the whole code space as candidates, refilled in place */
+static void evilReset(struct station *st)
+{
+  struct codeSpace sp;
+  struct codeIter it;
+  size_t got;
+
+  spaceInit(&sp, gameVariant, colors, seqlen);
+  iterInit(&it, &sp, spaceRange(&sp));
+  st->nCands = 0;
+  while ((got = iterFill(&it, st->cands + st->nCands, FILTER_BLOCK)) > 0)
+    st->nCands += got;
+  unpackSeq(st->cands[0], st->secret, seqlen);
+}
+
+/* the evil codemaker's answer to @guess@: the feedback class holding the most remaining secrets. One scoring pass */
+/* partitions the candidates by class; the winning class is then kept by compacting the array in place, and one of */
+/* its secrets becomes the station's secret, which the guess is scored against as usual                           */
+static void evilAnswer(struct station *st, code_t guess)
+{
+  unsigned int part[FB_CLASSES];
+  size_t before = st->nCands, kept = 0;
+  uint64_t start = piTimeNow();
+  int fb = 0;
+
+  memset(part, 0, sizeof(part));
+  gameVariant->classify(st->cands, st->nCands, guess, seqlen, st->cls, part);
+
+  // Ties go to the class with fewer exact matches, so the win is only conceded when there is nothing else left.
+
+  for (int c = 1; c < FB_CLASSES; c++)
+    if (part[c] > part[fb])
+      fb = c;
+  for (size_t i = 0; i < st->nCands; i++)
+    if (st->cls[i] == fb)
+      st->cands[kept++] = st->cands[i];
+  st->nCands = kept;
+  unpackSeq(st->cands[0], st->secret, seqlen);
+
+  logMsg(LOG_VERBOSE, stdout, "Evil codemaker: kept %llu of %llu secrets (%d exact, %d approximate) in %llu us\n",
+         (unsigned long long)kept, (unsigned long long)before, FB_EXACT(fb), FB_APPROX(fb),
+         (unsigned long long)(piTimeNow() - start));
+}
+
+/* (re-)initialise the per-game state of a station in place, with a fresh secret */
+static void stationNewGame(struct station *st)
+{
+  if (session.evil)
+    evilReset(st);
+  else if (session.fixedSecret)
+    memcpy(st->secret, theSeq, seqlen * sizeof(int));
+  else
+    drawSeq(st->secret);
+  st->attempts = 0;
+  st->rounds = 0;
+  st->state = ST_ROUND;
+  if (session.debug)
+  {
+    stationTag(st);
+    if (session.evil)
+      logMsg(LOG_OUT, stdout, "The evil codemaker keeps all %llu sequences possible\n", (unsigned long long)st->nCands);
+    else
+      showSeq(st->secret);
+  }
+}
+
+/* publish the state of @st@ to the telemetry block (plain stores inside the station's seqlock) */
+static void stationPublish(struct station *st, uint64_t now)
+{
+  struct telemetryStation *t;
+
+  if (telemetry == NULL || st->id >= TELEMETRY_STATIONS)
+    return;
+  t = &telemetry->station[st->id];
+  telemetryWriteBegin(t);
+  t->state = st->state;
+  t->games = st->gamesPlayed;
+  t->attempts = st->attempts;
+  t->digits = st->digit;
+  t->presses = st->count;
+  t->lastExact = st->lastExact;
+  t->lastApprox = st->lastApprox;
+  t->roundStart = st->roundStart;
+  t->lastRoundTime = st->lastRoundTime;
+  t->lastWindow = st->lastWindow;
+  t->updated = now;
+  telemetryWriteEnd(t);
+}
+
+static void stationInit(struct station *st, int id)
+{
+  memset(st, 0, sizeof(*st));
+  st->id = id;
+  st->lastExact = st->lastApprox = -1;
+  st->pins = stationPins[id];
+  st->histCap = 8;
+  st->hist = (struct histEntry *)malloc(st->histCap * sizeof(struct histEntry));
+  if (session.evil)
+  {
+    uint64_t size = gameVariant->size(colors, seqlen);
+
+    st->cands = (code_t *)malloc(size * sizeof(code_t));
+    st->cls = (uint8_t *)malloc(size);
+  }
+  stationNewGame(st);
+}
+
+/* the adaptive input window (-W adaptive): learn from the gap between two presses of the same digit, as a moving */
+/* average that follows the player's cadence over the session; then how long to wait after a press for the next   */
+static void learnCadence(struct station *st, uint64_t gap)
+{
+  st->cadence = st->cadence ? (3 * st->cadence + gap) / 4 : gap;
+}
+
+static uint64_t inputWindow(const struct station *st)
+{
+  uint64_t w = st->cadence ? WINDOW_FACTOR * st->cadence : session.windowMax;
+
+  if (w < session.windowMin)
+    w = session.windowMin;
+  if (w > session.windowMax)
+    w = session.windowMax;
+  return w;
+}
+
+/* the state machine proper; see stationStep */
+static void stationAdvance(struct station *st, uint64_t now, int press)
+{
+  switch (st->state)
+  {
+  case ST_OUTPUT:
+    if (now < st->deadline)
+      break;
+    if (st->curStep == st->nSteps)
+    {
+      st->nSteps = st->curStep = st->dropped = 0;
+      st->state = st->resume;
+      break;
+    }
+    st->level[0] = st->steps[st->curStep].level[0];
+    st->level[1] = st->steps[st->curStep].level[1];
+    st->deadline = now + st->steps[st->curStep].hold;
+    st->curStep++;
+    break;
+
+  case ST_ROUND:
+    st->attempts++;
+    st->digit = 0;
+    st->roundStart = now;
+
+    // The start of a new round is shown on the LEDs (but not before the first one).
+
+    if (st->attempts > 1)
+    {
+      stationTag(st);
+      logMsg(LOG_OUT, stdout, "Try Again!\n");
+      session.feedback->round(st);
+    }
+    startOutput(st, ST_DIGIT_START, now);
+    break;
+
+  case ST_DIGIT_START:
+    // The gap between two games is measured up to the moment the next one asks for its first digit.
+
+    if (st->gameOver)
+    {
+      logMsg(LOG_VERBOSE, stdout, "Next game ready %llu us after the last one ended\n",
+             (unsigned long long)(now - st->gameOver));
+      st->gameOver = 0;
+    }
+    stationTag(st);
+    logMsg(LOG_OUT, stdout, "Enter Digit %d \n", st->digit + 1);
+    st->count = 0;
+    st->state = ST_DIGIT_WAIT;
+    break;
+
+  case ST_DIGIT_WAIT:
+    // The user is forced to press the button at least once; the time-out only starts with the first press.
+
+    if (!press)
+      break;
+    st->deadline = now + TIMEOUT;
+    st->state = ST_DIGIT_COUNT;
+    /* fall through */
+
+  case ST_DIGIT_COUNT:
+    // With the fixed window the digit ends TIMEOUT after its first press. With the adaptive one, every press moves
+    // the end to a window after it, and the window follows how quickly the player has been pressing so far.
+
+    if (press)
+    {
+      if (st->count > 0 && !session.fixedWindow)
+        learnCadence(st, now - st->lastPress);
+      st->count++;
+      st->lastPress = now;
+      st->window = session.fixedWindow ? st->deadline - now : inputWindow(st);
+      st->deadline = now + st->window;
+      logMsg(LOG_OUT, stdout, "1");
+    }
+    if (now < st->deadline)
+      break;
+    logMsg(LOG_OUT, stdout, "\n");
+    st->lastWindow = st->window;
+    logMsg(LOG_VERBOSE, stdout, "Digit %d closed %llu ms after its last press (cadence %llu ms)\n", st->digit + 1,
+           (unsigned long long)st->window / 1000, (unsigned long long)st->cadence / 1000);
+
+    // We record the user-input; if the variant allows blanks, one press more than there are colours enters a blank.
+    // Any more presses than that are no colour at all: the digit is marked invalid (-1), as the guess is packed into
+    // 4 bits per peg, where a count of 16 or more would turn into a blank or a colour.
+
+    st->guess[st->digit] = st->count;
+    if (gameVariant->blanks && st->count == colors + 1)
+      st->guess[st->digit] = 0;
+    else if (st->count > colors)
+      st->guess[st->digit] = -1;
+
+    // The echo of a digit is bounded, so that it always fits into the LED queue: a digit with more presses than
+    // colours+1 is invalid anyway, and is echoed as colours+2.
+
+    session.feedback->digit(st, st->count > colors + 2 ? colors + 2 : st->count);
+    st->digit++;
+    startOutput(st, st->digit < seqlen ? ST_DIGIT_START : ST_INPUT_DONE, now);
+    break;
+
+  case ST_INPUT_DONE:
+    session.feedback->inputDone(st);
+    startOutput(st, ST_SCORE, now);
+    break;
+
+  case ST_SCORE:
+  {
+    int valid = 0, result;
+
+    // We go through a screening process just to make sure that there aren't any 0 (invalid) entries, as this is not
+    // allowed in our game (unless the variant allows blanks), nor any digits with too many presses (-1).
+
+    for (int k = 0; k < seqlen; k++)
+      if (st->guess[k] > 0 || (st->guess[k] == 0 && gameVariant->blanks))
+        valid++;
+    if (valid != seqlen)
+    {
+      st->state = ST_ROUND;
+      break;
+    }
+
+    // The evil codemaker decides on the secret only now, and only as far as it has to.
+
+    if (session.evil)
+      evilAnswer(st, packSeq(st->guess, seqlen));
+    result = countMatches(st->secret, st->guess);
+    if (session.debug)
+    {
+      stationTag(st);
+      showMatches(result, st->secret, st->guess, 1);
+    }
+
+    if (st->rounds == st->histCap)
+      st->hist = (struct histEntry *)realloc(st->hist, (st->histCap *= 2) * sizeof(struct histEntry));
+    st->hist[st->rounds].guess = packSeq(st->guess, seqlen);
+    st->hist[st->rounds].fb = FB(result / 10, result % 10);
+    st->rounds++;
+    st->lastExact = result / 10;
+    st->lastApprox = result % 10;
+    st->lastRoundTime = now - st->roundStart;
+    if (session.hints && result / 10 != seqlen && requestHint(st->id, st->hist, st->rounds, st->gamesPlayed) < 0)
+    {
+      stationTag(st);
+      showHint(st->hist, st->rounds);
+    }
+
+    session.feedback->score(st, result / 10, result % 10);
+    startOutput(st, result / 10 == seqlen ? ST_WON : ST_ROUND, now);
+    break;
+  }
+
+  case ST_WON:
+    stationTag(st);
+    logMsg(LOG_OUT, stdout, "You guessed the sequence correctly!\n");
+    stationTag(st);
+    logMsg(LOG_OUT, stdout, "You took %d attempts!\n\n", st->attempts);
+
+    session.feedback->won(st);
+    startOutput(st, ST_GAME_OVER, now);
+    break;
+
+  case ST_GAME_OVER:
+    stationTag(st);
+    logMsg(LOG_OUT, stdout, "Thank you for playing Mastermind! Have a great day :)\n");
+    st->gamesPlayed++;
+    if (session.games != 0 && st->gamesPlayed == session.games)
+    {
+      st->state = ST_DONE;
+      break;
+    }
+
+    // With -g the station goes straight into the next game: only the per-game state is reset, and the secret is
+    // swapped for the one prepared in the background.
+
+    logMsg(LOG_VERBOSE, stdout, "Game %d done in %d attempts\n", st->gamesPlayed, st->attempts);
+    st->gameOver = now;
+    stationNewGame(st);
+    break;
+
+  case ST_DONE:
+    break;
+  }
+}
+
+/* advance station @st@ at time @now@; @press@ is 1 if this is a (debounced) press of its button */
+static void stationStep(struct station *st, uint64_t now, int press)
+{
+  enum stationState before = st->state;
+  struct hint h;
+  int failed;
+
+  // A hint computed in the background is shown as soon as it is ready.
+
+  if (session.hints && takeHint(st->id, st->gamesPlayed, st->rounds, &h, &failed))
+  {
+    stationTag(st);
+    printHint(&h, failed);
+  }
+
+  // Presses only mean something while a digit is being entered.
+
+  if (press && st->state != ST_DIGIT_WAIT && st->state != ST_DIGIT_COUNT)
+    return;
+
+  stationAdvance(st, now, press);
+  stationLeds(st, now);
+
+  // Monitors see every press and every change of state; the LED steps in between are not worth publishing.
+
+  if (press || st->state != before)
+    stationPublish(st, now);
+}
+
+/* the event loop: every SCAN_PERIOD, the button events from the sampling thread are handed to their stations, */
+/* and every station advances its timers; until every station is done                                          */
+void runStations(void)
+{
+  struct station st[MAX_STATIONS];
+  struct buttonEvent ev;
+  int active;
+
+  samplerInit(&buttonSampler, gpio + 13, session.samplePeriod, DEBOUNCE_TIME);
+  for (int i = 0; i < session.stations; i++)
+  {
+    stationInit(&st[i], i);
+    stationPublish(&st[i], piTimeNow());
+    samplerAdd(&buttonSampler, st[i].pins.button);
+  }
+  if (samplerStart(&buttonSampler, session.realtime, session.rtCpu) != 0)
+  {
+    fprintf(stderr, "Cannot start the button sampling thread\n");
+    return;
+  }
+
+  do
+  {
+    uint64_t now;
+
+    // Presses are handled at the time they happened, which is what the time-outs of the digits count from.
+
+    while (eventPop(&buttonSampler.ring, &ev))
+      if (ev.press)
+        stationStep(&st[ev.button], ev.time, 1);
+
+    now = piTimeNow();
+    active = 0;
+    for (int i = 0; i < session.stations; i++)
+    {
+      stationStep(&st[i], now, 0);
+      if (st[i].state != ST_DONE)
+        active++;
+    }
+    delayMicroseconds(SCAN_PERIOD);
+  } while (active && !stopRequested);
+
+  // Stopped by a signal, a station may be in the middle of its feedback; its LEDs are switched off.
+
+  for (int i = 0; i < session.stations; i++)
+  {
+    st[i].level[0] = st[i].level[1] = 0;
+    stationLeds(&st[i], piTimeNow());
+  }
+  samplerStop(&buttonSampler);
+  for (int i = 0; i < session.stations; i++)
+  {
+    free(st[i].hist);
+    free(st[i].cands);
+    free(st[i].cls);
+  }
+}
+
+/* the self-test's stand-in for the LEDs: every change of a pin, at the simulated time @ledClock@ */
+static struct
+{
+  uint64_t time;
+  int pin, value;
+} ledRecord[LED_RECORD_MAX];
+static int ledRecords;
+static uint64_t ledClock;
+
+static void recordLedOut(int pin, int value)
+{
+  if (ledRecords < LED_RECORD_MAX)
+  {
+    ledRecord[ledRecords].time = ledClock;
+    ledRecord[ledRecords].pin = pin;
+    ledRecord[ledRecords].value = value;
+    ledRecords++;
+  }
+}
+
+/* for how many us of [@from@, @to@) @pin@ was high, according to the recording (it starts low) */
+static uint64_t recordedOnTime(int pin, uint64_t from, uint64_t to)
+{
+  uint64_t on = 0, since = 0;
+  int high = 0;
+
+  for (int i = 0; i <= ledRecords; i++)
+  {
+    uint64_t t = i < ledRecords ? ledRecord[i].time : to;
+
+    if (i < ledRecords && ledRecord[i].pin != pin)
+      continue;
+    if (high && t > from && since < to)
+      on += (t < to ? t : to) - (since > from ? since : from);
+    if (i < ledRecords)
+    {
+      high = ledRecord[i].value;
+      since = t;
+    }
+  }
+  return on;
+}
+
+// the signals of a feedback protocol, for the self-test
+enum feedbackSignal
+{
+  SIGNAL_ROUND,
+  SIGNAL_DIGIT,
+  SIGNAL_INPUT_DONE,
+  SIGNAL_SCORE,
+  SIGNAL_WON,
+  SIGNALS
+};
+
+static const char *signalNames[SIGNALS] = {"round", "digit", "input done", "score", "won"};
+
+/* play signal @signal@ of the current protocol (with @a@ presses, or @a@/@b@ matches) on a fresh station in */
+/* simulated time; returns how long it took, in us                                                           */
+static uint64_t playSignal(struct station *st, int signal, int a, int b)
+{
+  uint64_t t;
+
+  memset(st, 0, sizeof(*st));
+  st->pins = stationPins[0];
+  ledRecords = 0;
+  switch (signal)
+  {
+  case SIGNAL_ROUND:
+    session.feedback->round(st);
+    break;
+  case SIGNAL_DIGIT:
+    session.feedback->digit(st, a);
+    break;
+  case SIGNAL_INPUT_DONE:
+    session.feedback->inputDone(st);
+    break;
+  case SIGNAL_SCORE:
+    session.feedback->score(st, a, b);
+    break;
+  default:
+    session.feedback->won(st);
+  }
+  startOutput(st, ST_DONE, 0);
+  for (t = 0; st->state != ST_DONE; t += SCAN_PERIOD)
+  {
+    ledClock = t;
+    stationStep(st, t, 0);
+  }
+  return t - SCAN_PERIOD;
+}
+
+/* decode the first @slots@ pulses of the fast protocol from the recording into @got@ (counts of the green and red */
+/* LED, a bright pulse counting 2 and a dim one 1); returns 1 if a pulse was neither dim nor bright                  */
+static int decodePulses(const struct station *st, uint32_t unit, int slots, int *got)
+{
+  int bad = 0;
+
+  got[0] = got[1] = 0;
+  for (int i = 0; i < slots; i++)
+    for (int k = 0; k < 2; k++)
+    {
+      double share = (double)recordedOnTime(k == 0 ? st->pins.led : st->pins.led2, (uint64_t)2 * i * unit,
+                                             (uint64_t)(2 * i + 1) * unit) / unit;
+
+      got[k] += share > 0.6 ? 2 : share > 0.05 ? 1 : 0;
+      if ((share > 0.05 && share < 0.1) || (share > 0.3 && share < 0.95))
+        bad = 1;
+    }
+  return bad;
+}
+
+/* whether @got@ us of on-time is close enough to @want@: the PWM only switches on scan boundaries */
+static int onTimeOk(uint64_t got, uint64_t want)
+{
+  uint64_t slack = want / 20 + 2 * SCAN_PERIOD;
+
+  return got + slack >= want && got <= want + slack;
+}
+
+/* the LED feedback protocols against a recording of the pins. For every feedback possible in this configuration  */
+/* the fast protocol must decode to the right counts and take its timing table, the blink protocol must take its  */
+/* timing table. The other signals (new round, digit echo, input done, won) must take their timing tables and     */
+/* light each LED for as long as they should; the echo of the fast protocol must decode to the presses. Returns   */
+/* the number of failed cases.                                                                                    */
+int selfTestFeedback(uint32_t unit)
+{
+  const struct feedbackProtocol *saved = session.feedback;
+  struct station st;
+  int failed = 0;
+
+  session.unit = unit;
+  ledOut = recordLedOut;
+  for (int exact = 0; exact <= seqlen; exact++)
+    for (int approx = 0; exact + approx <= seqlen; approx++)
+    {
+      int pulses = (exact > approx ? exact + 1 : approx + 1) / 2, got[2], bad = 0;
+      uint64_t fast, blink, blinkTable;
+
+      // The blink protocol: 400 ms per blink, three separators of 1 s around the red blink, 0.5 s more for a win.
+
+      session.feedback = findFeedback("blink");
+      blink = playSignal(&st, SIGNAL_SCORE, exact, approx);
+      blinkTable = (exact || approx ? (uint64_t)400000 * (exact + approx + 1) + 3000000 : 0) + (exact == seqlen ? 500000 : 0);
+      if (blink != blinkTable)
+        bad = 1;
+
+      // The fast protocol: a unit on and a unit off per pulse, both LEDs at once, then a unit of pause. We decode the
+      // pulses from the on-time of the pins in every unit they may be lit.
+
+      session.feedback = findFeedback("fast");
+      fast = playSignal(&st, SIGNAL_SCORE, exact, approx);
+      if (fast != (uint64_t)(2 * pulses + 1) * unit || st.lit[0] || st.lit[1])
+        bad = 1;
+      bad |= decodePulses(&st, unit, (seqlen + 1) / 2 + 1, got);
+      if (got[0] != exact || got[1] != approx)
+        bad = 1;
+
+      failed += bad;
+      fprintf(stdout, "%s %d/%d: fast %llu ms, read as %d/%d; blink %llu ms\n", bad ? "FAIL" : "ok  ", exact, approx,
+              (unsigned long long)fast / 1000, got[0], got[1], (unsigned long long)blink / 1000);
+    }
+
+  // The other signals, with every count of presses a digit can be echoed with (see ST_DIGIT_COUNT). The tables give
+  // the duration and the on-time of the green and the red LED; a dim unit is lit for PWM_DIM/PWM_LEVELS of it.
+
+  for (int signal = 0; signal < SIGNALS; signal++)
+    for (int c = 1; c <= (signal == SIGNAL_DIGIT ? colors + 2 : 1); c++)
+    {
+      uint64_t dim = (uint64_t)unit * PWM_DIM / PWM_LEVELS, want[2][3], took[2];
+      int bad = 0, got[2] = {0, 0};
+
+      if (signal == SIGNAL_SCORE)
+        continue;
+      switch (signal)
+      {
+      case SIGNAL_ROUND:
+        want[0][0] = 1200000, want[0][1] = 0, want[0][2] = 600000;
+        want[1][0] = 2 * unit, want[1][1] = 0, want[1][2] = unit;
+        break;
+      case SIGNAL_DIGIT:
+        want[0][0] = 1000000 + (uint64_t)400000 * (c + 1), want[0][1] = (uint64_t)200000 * c, want[0][2] = 200000;
+        want[1][0] = (uint64_t)(2 * ((c + 1) / 2) + 1) * unit;
+        want[1][1] = (uint64_t)(c / 2) * unit + (c % 2) * dim, want[1][2] = 0;
+        break;
+      case SIGNAL_INPUT_DONE:
+        want[0][0] = 2800000, want[0][1] = 0, want[0][2] = 400000;
+        want[1][0] = 2 * unit, want[1][1] = dim, want[1][2] = dim;
+        break;
+      default:
+        // (the red LED is switched on and off by steps of no duration, each of which still takes a scan)
+        want[0][0] = 1200000 + 2 * SCAN_PERIOD, want[0][1] = 600000, want[0][2] = 1200000;
+        want[1][0] = 6 * unit, want[1][1] = 3 * unit, want[1][2] = 3 * unit;
+      }
+      for (int p = 0; p < 2; p++)
+      {
+        session.feedback = findFeedback(p == 0 ? "blink" : "fast");
+        took[p] = playSignal(&st, signal, c, 0);
+        if (took[p] != want[p][0] || st.lit[0] || st.lit[1] ||
+            !onTimeOk(recordedOnTime(st.pins.led, 0, took[p]), want[p][1]) ||
+            !onTimeOk(recordedOnTime(st.pins.led2, 0, took[p]), want[p][2]))
+          bad = 1;
+        if (p == 1 && signal == SIGNAL_DIGIT)
+        {
+          bad |= decodePulses(&st, unit, (c + 1) / 2 + 1, got);
+          if (got[0] != c || got[1] != 0)
+            bad = 1;
+        }
+      }
+
+      failed += bad;
+      fprintf(stdout, "%s %s", bad ? "FAIL" : "ok  ", signalNames[signal]);
+      if (signal == SIGNAL_DIGIT)
+        fprintf(stdout, " %d (fast read as %d)", c, got[0]);
+      fprintf(stdout, ": fast %llu ms; blink %llu ms\n", (unsigned long long)took[1] / 1000,
+              (unsigned long long)took[0] / 1000);
+    }
+  session.feedback = saved;
+  ledOut = gpioLedOut;
+  return failed;
+}
+
+/* ======================================================= */
+/* SECTION: main fct                                       */
+/* ------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{ // this is just a suggestion of some variable that you may want to use
+  int bits, rows, cols;
+  unsigned char func;
+
+  int j, code;
+  int c, d, buttonPressed, rel, foo;
+
+  int fSel, shift, pin, clrOff, setOff, off, res;
+
+  int exact, contained;
+  char str1[32];
+  char str2[32];
+
+  struct timeval t1, t2;
+  int t;
+
+  char buf[32];
+
+  // variables for command-line processing
+  char str_in[20], str[20] = "some text";
+  int verbose = 0, debug = 0, help = 0, opt_m = 0, opt_n = 0, opt_s = 0, unit_test = 0, res_matches = 0;
+  int games = 1, realtime = 0, rtCpu = -1, hints = 0, stations = 1, hintBudget = 0;
+  int sampleRate = 1000000 / SAMPLE_PERIOD;
+  char *selfTest = NULL;
+  const struct feedbackProtocol *feedback = findFeedback("blink");
+  int unit = FAST_UNIT / 1000;
+  int evil = 0;
+  char *streamIn = NULL, *streamOut = NULL, *exportDir = NULL;
+  int configGiven = 0; // any of -V, -C, -L
+  int expected = 0;
+  int fixedWindow = 0, windowMin = WINDOW_MIN / 1000, windowMax = WINDOW_MAX / 1000;
+
+  // -------------------------------------------------------
+  // process command-line arguments
+
+  // see: man 3 getopt for docu and an example of command line parsing
+  { 
+    int opt;
+    while ((opt = getopt(argc, argv, "hvdus:g:R::HV:S:B:f:T:F:C:L:EW:I:O:X:A")) != -1)
+    {
+      switch (opt)
+      {
+      case 'v':
+        verbose = 1;
+        break;
+      case 'h':
+        help = 1;
         break;
       case 'd':
         debug = 1;
@@ -730,8 +5074,145 @@ int main(int argc, char *argv[])
       case 's':
         opt_s = atoi(optarg);
         break;
+      case 'g':
+        games = atoi(optarg);
+        break;
+      case 'H':
+        hints = 1;
+        break;
+      case 'B':
+      {
+        char *end;
+        long ms = strtol(optarg, &end, 10);
+
+        if (end == optarg || *end != '\0' || ms < 0 || ms > INT32_MAX / 1000)
+        {
+          fprintf(stderr, "Hint budget must be a number of ms between 0 and %d\n", INT32_MAX / 1000);
+          exit(EXIT_FAILURE);
+        }
+        hintBudget = (int)ms;
+        break;
+      }
+      case 'f':
+        sampleRate = atoi(optarg);
+        if (sampleRate < 1 || sampleRate > 100000)
+        {
+          fprintf(stderr, "Sample rate must be between 1 and 100000 Hz\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'T':
+        selfTest = optarg;
+        break;
+      case 'F':
+      {
+        // -F blink, -F fast, or -F fast:<unit ms>
+        char *colon = strchr(optarg, ':');
+
+        if (colon != NULL)
+        {
+          char *end;
+
+          *colon = '\0';
+          unit = (int)strtol(colon + 1, &end, 10);
+          if (end == colon + 1 || *end != '\0')
+            unit = 0; // rejected below
+        }
+        if ((feedback = findFeedback(optarg)) == NULL)
+        {
+          fprintf(stderr, "Unknown feedback protocol %s (expected blink or fast)\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        if (colon != NULL && strcmp(feedback->name, "fast") != 0)
+        {
+          fprintf(stderr, "Only the fast feedback protocol takes a unit (-F fast:<unit ms>)\n");
+          exit(EXIT_FAILURE);
+        }
+        if (unit < 2 * PWM_PERIOD / 1000 || unit > 1000)
+        {
+          fprintf(stderr, "Feedback unit must be between %d and 1000 ms\n", 2 * PWM_PERIOD / 1000);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'C':
+        colors = atoi(optarg);
+        if (colors < 2 || colors > STREAM_MAX_COLS)
+        {
+          fprintf(stderr, "Number of colours must be between 2 and %d\n", STREAM_MAX_COLS);
+          exit(EXIT_FAILURE);
+        }
+        configGiven = 1;
+        break;
+      case 'L':
+        seqlen = atoi(optarg);
+        if (seqlen < 1 || seqlen > STREAM_MAX_SEQL)
+        {
+          fprintf(stderr, "Length of the sequence must be between 1 and %d\n", STREAM_MAX_SEQL);
+          exit(EXIT_FAILURE);
+        }
+        configGiven = 1;
+        break;
+      case 'E':
+        evil = 1;
+        break;
+      case 'I':
+        streamIn = optarg;
+        break;
+      case 'O':
+        streamOut = optarg;
+        break;
+      case 'X':
+        exportDir = optarg;
+        break;
+      case 'A':
+        expected = 1;
+        break;
+      case 'W':
+      {
+        // -W fixed, -W adaptive, or -W adaptive:<min ms>:<max ms> (and nothing after it)
+        int end = 0;
+
+        if (strcmp(optarg, "fixed") == 0)
+          fixedWindow = 1;
+        else if (strcmp(optarg, "adaptive") == 0 ||
+                 (sscanf(optarg, "adaptive:%d:%d%n", &windowMin, &windowMax, &end) == 2 && optarg[end] == '\0'))
+          fixedWindow = 0;
+        else
+        {
+          fprintf(stderr, "Unknown input window %s (expected fixed or adaptive[:<min ms>:<max ms>])\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        if (windowMin < 50 || windowMax < windowMin)
+        {
+          fprintf(stderr, "Input window must be at least 50 ms, and its minimum no larger than its maximum\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'S':
+        stations = atoi(optarg);
+        if (stations < 1 || stations > MAX_STATIONS)
+        {
+          fprintf(stderr, "Number of stations must be between 1 and %d\n", MAX_STATIONS);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'V':
+        if ((gameVariant = findVariant(optarg)) == NULL)
+        {
+          fprintf(stderr, "Unknown variant %s (expected classic, nodup or blanks)\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        configGiven = 1;
+        break;
+      case 'R':
+        realtime = 1;
+        if (optarg)
+          rtCpu = atoi(optarg);
+        break;
       default: /* '?' */
-        fprintf(stderr, "Usage: %s [-h] [-v] [-d] [-u <seq1> <seq2>] [-s <secret seq>]  \n", argv[0]);
+        fprintf(stderr, "Usage: %s [-h] [-v] [-d] [-u <seq1> <seq2>] [-s <secret seq>] [-g <games>] [-R[<cpu>]] [-H] [-V classic|nodup|blanks] [-C <colours>] [-L <length>] [-E] [-W fixed|adaptive[:<min ms>:<max ms>]] [-I <candidate file>] [-O <candidate file> <guess>:<exact>:<approx>...] [-X <dataset dir>] [-A] [-S <stations>] [-B <hint budget ms>] [-f <sample rate Hz>] [-F blink|fast[:<unit ms>]] [-T debounce|feedback]  \n", argv[0]);
         exit(EXIT_FAILURE);
       }
     }
@@ -742,10 +5223,44 @@ int main(int argc, char *argv[])
     fprintf(stderr, "MasterMind program, running on a Raspberry Pi, with connected LED, button and LCD display\n");
     fprintf(stderr, "Use the button for input of numbers. The LCD display will show the matches with the secret sequence.\n");
     fprintf(stderr, "For full specification of the program see: https://www.macs.hw.ac.uk/~hwloidl/Courses/F28HS/F28HS_CW2_2022.pdf\n");
-    fprintf(stderr, "Usage: %s [-h] [-v] [-d] [-u <seq1> <seq2>] [-s <secret seq>]  \n", argv[0]);
+    fprintf(stderr, "Usage: %s [-h] [-v] [-d] [-u <seq1> <seq2>] [-s <secret seq>] [-g <games>] [-R[<cpu>]] [-H] [-V classic|nodup|blanks] [-C <colours>] [-L <length>] [-E] [-W fixed|adaptive[:<min ms>:<max ms>]] [-I <candidate file>] [-O <candidate file> <guess>:<exact>:<approx>...] [-X <dataset dir>] [-A] [-S <stations>] [-B <hint budget ms>] [-f <sample rate Hz>] [-F blink|fast[:<unit ms>]] [-T debounce|feedback]  \n", argv[0]);
     exit(EXIT_SUCCESS);
   }
 
+  // Colours and length are checked against the variant only once all options are in: without duplicates, there
+  // must be at least as many colours as pegs. Beyond MAX_COLS/MAX_SEQL only the stream filter (-O) works.
+
+  if (streamOut == NULL && (colors > MAX_COLS || seqlen > MAX_SEQL))
+  {
+    fprintf(stderr, "More than %d colours or %d pegs need the stream filter (-O)\n", MAX_COLS, MAX_SEQL);
+    exit(EXIT_FAILURE);
+  }
+
+  if (gameVariant->size(colors, seqlen) == 0)
+  {
+    fprintf(stderr, "No %s sequences of length %d with %d colours\n", gameVariant->name, seqlen, colors);
+    exit(EXIT_FAILURE);
+  }
+  if (evil && opt_s)
+  {
+    fprintf(stderr, "The evil codemaker (-E) does not take a secret sequence (-s)\n");
+    exit(EXIT_FAILURE);
+  }
+  if (evil && gameVariant->size(colors, seqlen) > EVIL_MAX_CODES)
+  {
+    fprintf(stderr, "The evil codemaker (-E) plays at most %d sequences\n", EVIL_MAX_CODES);
+    exit(EXIT_FAILURE);
+  }
+
+  // An exact hint grows with the square of the candidates; in a large game it would not come before the next guess.
+
+  if (hints && hintBudget == 0 && gameVariant->size(colors, seqlen) > HINT_EXACT_MAX)
+  {
+    fprintf(stderr, "Exact hints (-H without -B) are given for at most %d sequences; set a hint budget with -B\n",
+            HINT_EXACT_MAX);
+    exit(EXIT_FAILURE);
+  }
+
   if (unit_test && optind >= argc - 1)
   {
     fprintf(stderr, "Expected 2 arguments after option -u\n");
@@ -766,6 +5281,25 @@ int main(int argc, char *argv[])
     fprintf(stdout, "Unittest is %s\n", (unit_test ? "ON" : "OFF"));
     if (opt_s)
       fprintf(stdout, "Secret sequence set to %d\n", opt_s);
+    if (games != 1)
+      fprintf(stdout, "Games per process: %d%s\n", games, (games == 0 ? " (endless)" : ""));
+    fprintf(stdout, "Real-time mode is %s\n", (realtime ? "ON" : "OFF"));
+    fprintf(stdout, "Hints are %s\n", (hints ? "ON" : "OFF"));
+    if (hintBudget)
+      fprintf(stdout, "Hint budget: %d ms\n", hintBudget);
+    fprintf(stdout, "Variant is %s\n", gameVariant->name);
+    fprintf(stdout, "Colours: %d, length of the sequence: %d\n", colors, seqlen);
+    fprintf(stdout, "Evil codemaker is %s\n", (evil ? "ON" : "OFF"));
+    if (fixedWindow)
+      fprintf(stdout, "Input window: fixed, %d ms after the first press\n", TIMEOUT / 1000);
+    else
+      fprintf(stdout, "Input window: adaptive, %d to %d ms after the last press\n", windowMin, windowMax);
+    fprintf(stdout, "Stations: %d\n", stations);
+    fprintf(stdout, "Button sample rate: %d Hz\n", sampleRate);
+    fprintf(stdout, "Feedback protocol: %s", feedback->name);
+    if (strcmp(feedback->name, "fast") == 0)
+      fprintf(stdout, ", unit %d ms", unit);
+    fprintf(stdout, "\n");
   }
 
   seq1 = (int *)malloc(seqlen * sizeof(int));
@@ -794,6 +5328,37 @@ int main(int argc, char *argv[])
     /* nothing to do here; just continue with the rest of the main fct */
   }
 
+  // check for -T option, and if so run a self-test against simulated hardware
+  if (selfTest != NULL)
+  {
+    if (strcmp(selfTest, "debounce") == 0)
+      exit(selfTestDebounce() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    if (strcmp(selfTest, "feedback") == 0)
+      exit(selfTestFeedback((uint32_t)unit * 1000) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    fprintf(stderr, "Unknown self-test %s\n", selfTest);
+    exit(EXIT_FAILURE);
+  }
+
+  // check for -O option, and if so filter the code space (or the candidate file of -I) by the constraints given
+  // as further arguments into a candidate file, without playing
+  if (streamOut != NULL)
+    exit(streamFilter(streamIn, streamOut, argv + optind, argc - optind, configGiven) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+  // check for -A option, and if so print the strategy with the fewest guesses on average, without playing
+  if (expected)
+    exit(expectedSolve() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+  // check for -X option, and if so play -g games with the hint solver and export them as a dataset, without playing
+  if (exportDir != NULL)
+  {
+    if (games < 1)
+    {
+      fprintf(stderr, "The dataset export (-X) needs a number of games (-g)\n");
+      exit(EXIT_FAILURE);
+    }
+    exit(exportDataset(exportDir, games, (uint64_t)hintBudget * 1000) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   if (opt_s)
   { // if -s option is given, use the sequence as secret sequence
     if (theSeq == NULL)
@@ -815,238 +5380,75 @@ int main(int argc, char *argv[])
   if (geteuid() != 0)
     fprintf(stderr, "setup: Must be root. (Did you forget sudo?)\n");
 
-  // init of guess sequence, and copies (for use in countMatches)
-  attSeq = (int *)malloc(seqlen * sizeof(int));
+  // init of the copies (for use in countMatches); every station keeps its own guess sequence
   cpy1 = (int *)malloc(seqlen * sizeof(int));
   cpy2 = (int *)malloc(seqlen * sizeof(int));
 
-  // -----------------------------------------------------------------------------
-  // constants for RPi2
-  gpiobase = 0x3F200000;
-  timebase = 0x3F003000;
-  // -----------------------------------------------------------------------------
-  // memory mapping
-  // Open the master /dev/memory device
-
-  if ((fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
-    return failure(FALSE, "setup: Unable to open /dev/mem: %s\n", strerror(errno));
-
-  // GPIO:
-  gpio = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, gpiobase);
-  if ((int32_t)gpio == -1)
-    return failure(FALSE, "setup: mmap (GPIO) failed: %s\n", strerror(errno));
-
-  piTime = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, timebase);
-  
-
-  /* initialise the secret sequence */
-  if (!opt_s)
-    initSeq();
-  if (debug)
-    showSeq(theSeq);
-
-  // optionally one of these 2 calls:
-  waitForEnter () ;
-  // waitForButton (gpio, pinButton) ;
-
-  // -----------------------------------------------------------------------------
-  // +++++ main loop
-
-  // We set up the modes of our hardwares as follows.
-
-  // Since our LEDs emit light, we set them to OUTPUT and as users enter values through the button, we set that to INPUT.
-
-  pinMode(gpio, pinLED, OUTPUT);
-  pinMode(gpio, pin2LED2, OUTPUT);
-  pinMode(gpio, pinButton, INPUT);
-
-  while (!found)
-  {
-    attempts++;
-
-    // This gets omitted if it is still only the first round being played, however the program goes into this for every
-    // other round being played.
-
-    if (attempts > 1)
-    {
-      // According to the Game Functionality section from the coursework specs, the red control LED should blink three
-      // times to indicate the start of a new round.
-
-      // Therefore, we are doing exactly that with the help of the blinkN() method.
-
-      printf("Try Again!\n");
-      blinkN(gpio, pin2LED2, 3);
-    }
-
-    // There will be a total of 3 rounds that will be played, therefore we implement a for loop with 3 iterations.
-
-    for (int i = 0; i < 3; i++)
-    {
-      int count = 0;
-      {
-        volatile uint32_t ts = *(piTime + 1); // word offset
-        printf("Enter Digit %d \n",i+1);
-
-        // As long as the button is pressed before 3 seconds are up:
-
-        while ((*(piTime + 1) - ts) < TIMEOUT)
-        {
-          if (readButton(gpio, pinButton))
-          {
-
-            // The number of times it is pressed is counted.
+  // From here on, all game output goes through the asynchronous logger, so that the button loop never waits for the
+  // terminal.
 
-            count++;
-            fprintf(stdout,"1");
-          }
+  logStart(verbose, debug);
 
-          // If not, the timer is reset and the user gets to press the button again. This way, we ensure that we dont
-          // carry forward a button input of 0 in the game. The user is forced to press the button atleast once, else
-          // the program won't advance further.
+  // The hardware is set up exactly once per process; every further game re-uses the same mappings and pin modes.
 
-          if (count == 0)
-          {
-            ts = *(piTime + 1);
-          }
-        }
-        printf("\n");
-      }
-
-      // We record the user-inputs in the array attSeq
-
-      attSeq[i] = count;
-
-      // We add a delay in order to prevent the flow of execution from occuring too fast.
-
-      delayMicroseconds(1000000);
-
-      // We blink the red LED once to acknowledge the input of the number followed by blinking the green LED as many
-      // times as the button was pressed.
-
-      blinkN(gpio, pin2LED2, 1);
-      blinkN(gpio, pinLED, count);
-    }
-
-    // We add a delay in order to prevent the flow of execution from occuring too fast.
-
-    delayMicroseconds(2000000);
-
-    // Once all values have been entered and echoed, the red control LED is blinked twice to indicate the end of the input.
-
-    blinkN(gpio, pin2LED2, 2);
-    int valid = 0;
-
-    // We go through a screening process just to make sure that there aren't any 0 (invalid) entries as this is not
-    // allowed in our game. We increment a counter for every element that we validate.
-
-    for (int k = 0; k < 3; k++)
-    {
-      if (attSeq[i] != 0)
-      {
-        valid++;
-      }
-    }
-
-    // Once we've finished validation of all 3 elements, we get the results using the countMatches method.
-
-    if (valid == 3)
-    {
-      int result = countMatches(theSeq, attSeq);
-      if(debug){
-        showMatches(result,theSeq,attSeq, 1);
-      }
-      // If the result was 30, this would mean that the user has guessed the system-generated sequence correctly with
-      // 3 exact matches and 0 approximate ones.
-
-      if (result == 30)
-      {
-        // We first make the green LED blink the number of exact matches.
-
-        blinkN(gpio, pinLED, (result / 10));
-
-        // We then add a delay in order to prevent the flow of execution from occuring too fast.
-
-        delayMicroseconds(1000000);
-
-        // To serve as a separator, we blink the red LED once.
-
-        blinkN(gpio, pin2LED2, 1);
-
-        // We then add a delay in order to prevent the flow of execution from occuring too fast.
-
-        delayMicroseconds(1000000);
-
-        // Finally, we make the green LED blink the number of approximate matches.
-
-        blinkN(gpio, pinLED, (result % 10));
-
-        // Followed by a delay in order to prevent the flow of execution from occuring too fast.
-
-        delayMicroseconds(1000000);
-               
-
-        // We increment our found counter to signify that the user has completed the game successfully.
-
-        found++;
-        delayMicroseconds(500000);
-      }
-
-      // If the result is something else, then this would mean that the user did not guess the sequence correctly.
-      // If this is the case
-
-      else if ((result % 10) != 0 || (result / 10) != 0)
-      {
-
-        // We first make the green LED blink the number of exact matches.
-
-        blinkN(gpio, pinLED, (result / 10));
-
-        // We then add a delay in order to prevent the flow of execution from occuring too fast.
-
-        delayMicroseconds(1000000);
-
-        // To serve as a separator, we blink the red LED once.
-
-        blinkN(gpio, pin2LED2, 1);
-
-        // We then add a delay in order to prevent the flow of execution from occuring too fast.
+  if (setupHardware(stations) < 0)
+    return -1;
 
-        delayMicroseconds(1000000);
+  // Monitors can follow the game through the telemetry block (see mm-telemetry); it is optional.
 
-        // Finally, we make the green LED blink the number of approximate matches.
+  if (telemetryOpen(stations) < 0)
+    logMsg(LOG_VERBOSE, stderr, "Running without telemetry\n");
 
-        blinkN(gpio, pinLED, (result % 10));
+  // Unless a fixed secret was given with -s (or the evil codemaker plays without one), the next secret is always
+  // generated in the background while the current game is played, so that a new game can start the moment the
+  // previous one ends.
 
-        // Followed by a delay in order to prevent the flow of execution from occuring too fast.
+  if (!opt_s && !evil)
+    startSeqPrefetch();
 
-        delayMicroseconds(1000000);
-        // showMatches(result);
-      }
-    }
+  // Hints are computed by a thread of their own, so that the event loop never waits for one.
 
-  }
+  if (hints)
+    startHintWorker();
 
-  // If the result was 30, the user has completed the game successfully and the program thus goes into the following if
-  // condition:
+  // In real-time mode the button sampling thread is pinned and promoted when it starts; the jitter it measured is
+  // reported at exit, which includes a stop by SIGINT or SIGTERM.
 
-  if (found)
-  {
-    /* ***  COMPLETE the code here  ***  */
-    printf("You guessed the sequence correctly!\n");
-    printf("You took %d attempts!\n\n", attempts);
+  if (realtime)
+    atexit(reportJitter);
+  catchStopSignals();
 
-    // We make the green LED blink three times while the red LED is turned on in order to represent the end of the game.
+  // optionally one of these 2 calls:
+  waitForEnter () ;
+  // waitForButton (gpio, pinButton) ;
 
-    writeLED(gpio, pin2LED2, HIGH);
-    blinkN(gpio, pinLED, 3);
-    writeLED(gpio, pin2LED2, LOW);
+  // -----------------------------------------------------------------------------
+  // +++++ main loop
 
-    printf("Thank you for playing Mastermind! Have a great day :)\n");
-    exit(0);
-  }
-  else
-  {
-    fprintf(stdout, "Sequence not found\n");
-  }
+  // Every station plays its games (with -g game after game, -g 0 never stops) from one event loop.
+
+  session.stations = stations;
+  session.games = games;
+  session.debug = debug;
+  session.hints = hints;
+  session.hintBudget = (uint64_t)hintBudget * 1000;
+  session.samplePeriod = 1000000 / sampleRate;
+  session.realtime = realtime;
+  session.rtCpu = rtCpu;
+  session.fixedSecret = (opt_s != 0);
+  session.evil = evil;
+  session.fixedWindow = fixedWindow;
+  session.windowMin = (uint64_t)windowMin * 1000;
+  session.windowMax = (uint64_t)windowMax * 1000;
+  session.feedback = feedback;
+  session.unit = (uint32_t)unit * 1000;
+  if (!stopRequested)
+    runStations();
+
+  stopSeqPrefetch();
+  stopHintWorker();
+  if (hints)
+    hintReport();
+  logShutdown();
   return 0;
 }
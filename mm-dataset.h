@@ -0,0 +1,41 @@
+/* ======================================================= */
+/* Columnar datasets exported by the MasterMind program    */
+/* ------------------------------------------------------- */
+/* master-mind -X <dir> -g <games> plays games with the hint solver and writes one row per guess, one file per */
+/* column: <dir>/<column>.col is a DATASET_HEADER_SIZE header (struct datasetHeader, zero-padded) followed by   */
+/* @rows@ fixed-width values in the byte order of the Pi (little-endian). Row i of every column describes the   */
+/* same guess, so a reader can mmap just the columns it needs and index them directly. The rounds of a game are  */
+/* in order, but games written by different threads interleave in blocks. The columns are:                       */
+/*   game      u32  number of the game, from 0                                                                  */
+/*   round     u8   number of the guess in its game, from 1                                                     */
+/*   secret    u64  the secret, packed 4 bits per peg with peg 1 in the lowest bits (0 is a blank)              */
+/*   guess     u64  the guess, packed the same way                                                              */
+/*   exact     u8   pegs of the guess right in colour and position                                              */
+/*   approx    u8   further pegs right in colour only                                                           */
+/*   remaining u32  secrets still consistent after the feedback                                                 */
+/*   worst     u32  largest feedback class of the guess among the secrets consistent before it                  */
+/*   classes   u8   number of feedback classes the guess splits those secrets into                              */
+
+#ifndef MM_DATASET_H
+#define MM_DATASET_H
+
+#include <stdint.h>
+
+#define DATASET_MAGIC 0x53444d4du // "MMDS"
+#define DATASET_VERSION 1
+#define DATASET_HEADER_SIZE 4096
+
+struct datasetHeader
+{
+  uint32_t magic, version;
+  char column[16]; // name of the column, as in the file name
+  char type[8];    // "u8", "u32" or "u64"
+  uint32_t width;  // bytes per value
+  uint32_t pad;
+  uint64_t rows;   // values in the column
+  uint64_t games;  // games the rows come from
+  char variant[16]; // configuration the games were played in
+  int32_t colors, len;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/* ======================================================= */
+/* Reader for the live telemetry of MasterMind processes   */
+/* ------------------------------------------------------- */
+/* samples the shared memory blocks of all running master-mind processes and prints the state of every      */
+/* station. It only maps the blocks read-only and never takes a lock, so it cannot slow down a game.        */
+/* Usage: mm-telemetry [-w <interval ms>]                                                                   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mm-telemetry.h"
+
+/* where shm_open() objects live on Linux */
+#define SHM_DIR "/dev/shm"
+
+static const char *stateNames[] = TELEMETRY_STATE_NAMES;
+
+/* print the state of all stations of the process behind the shared memory object @name@ */
+static int showBlock(const char *name)
+{
+  const struct telemetryBlock *blk;
+  char path[256];
+  int fd, stale;
+
+  snprintf(path, sizeof(path), "/%s", name);
+  if ((fd = shm_open(path, O_RDONLY, 0)) < 0)
+    return -1;
+  blk = (const struct telemetryBlock *)mmap(NULL, sizeof(struct telemetryBlock), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (blk == MAP_FAILED)
+    return -1;
+
+  if (blk->magic != TELEMETRY_MAGIC || blk->version != TELEMETRY_VERSION)
+  {
+    fprintf(stderr, "%s: not a telemetry block (or a different version)\n", name);
+    munmap((void *)blk, sizeof(struct telemetryBlock));
+    return -1;
+  }
+
+  // A process that crashed leaves its block behind; we still show it, but say so.
+
+  stale = kill(blk->pid, 0) != 0 && errno == ESRCH;
+  printf("pid %d%s, %d station(s)\n", blk->pid, stale ? " (not running)" : "", blk->stations);
+  for (int i = 0; i < blk->stations && i < TELEMETRY_STATIONS; i++)
+  {
+    struct telemetryStation t;
+    int retries = telemetryRead(&blk->station[i], &t);
+
+    // A writer that stopped in the middle of an update leaves the station half-written; there is nothing to show.
+
+    if (retries < 0)
+    {
+      printf("  station %d: torn (%s in the middle of an update)\n", i + 1, stale ? "writer died" : "writer stuck");
+      continue;
+    }
+    printf("  station %d: %-16s game %d, attempt %d, digit %d (%d presses)", i + 1,
+           (t.state >= 0 && t.state < (int)(sizeof(stateNames) / sizeof(stateNames[0]))) ? stateNames[t.state] : "?",
+           t.games + 1, t.attempts, t.digits + 1, t.presses);
+    if (t.lastExact >= 0)
+      printf(", last feedback %d exact %d approximate after %.1f s", t.lastExact, t.lastApprox, t.lastRoundTime / 1e6);
+    if (t.lastWindow)
+      printf(", input window %.2f s", t.lastWindow / 1e6);
+    if (retries)
+      printf(" [%d retries]", retries);
+    printf("\n");
+  }
+  munmap((void *)blk, sizeof(struct telemetryBlock));
+  return 0;
+}
+
+/* show every telemetry block there is; returns how many were found */
+static int showAll(void)
+{
+  DIR *dir = opendir(SHM_DIR);
+  struct dirent *de;
+  int found = 0;
+
+  if (dir == NULL)
+  {
+    fprintf(stderr, "Cannot open %s: %s\n", SHM_DIR, strerror(errno));
+    return 0;
+  }
+  while ((de = readdir(dir)) != NULL)
+    if (strncmp(de->d_name, TELEMETRY_PREFIX + 1, strlen(TELEMETRY_PREFIX) - 1) == 0 && showBlock(de->d_name) == 0)
+      found++;
+  closedir(dir);
+  return found;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt, interval = 0;
+
+  while ((opt = getopt(argc, argv, "hw:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'w':
+      interval = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-w <interval ms>]\n", argv[0]);
+      exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  // With -w we keep sampling every @interval@ ms; otherwise we take one sample.
+
+  do
+  {
+    if (showAll() == 0)
+      printf("no MasterMind processes running\n");
+    if (interval > 0)
+    {
+      struct timespec sleeper = {interval / 1000, (long)(interval % 1000) * 1000000};
+
+      printf("\n");
+      nanosleep(&sleeper, NULL);
+    }
+  } while (interval > 0);
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+/* ======================================================= */
+/* Live telemetry of the MasterMind program                */
+/* ------------------------------------------------------- */
+/* every running master-mind process publishes the state of its stations in a shared memory block named      */
+/* TELEMETRY_PREFIX<pid>. The game only ever does plain stores into it; every station is guarded by its own   */
+/* seqlock (odd @seq@ while an update is in progress), so readers never block or slow down the game, they     */
+/* just retry when they raced with an update. See mm-telemetry.c for the reader.                              */
+
+#ifndef MM_TELEMETRY_H
+#define MM_TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_PREFIX "/mastermind."
+#define TELEMETRY_MAGIC 0x4d4d544cu // "MMTL"
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_STATIONS 4
+// a reader gives up on a station after this many tries; an update takes well under a us, so only a dead writer hits it
+#define TELEMETRY_READ_TRIES 100000
+
+// names of the station states, in the order of enum stationState in master-mind.c
+#define TELEMETRY_STATE_NAMES                                                                                    \
+  {                                                                                                              \
+    "new round", "prompt digit", "wait for press", "counting presses", "input done", "scoring", "won", "game over", \
+        "showing LEDs", "done"                                                                                    \
+  }
+
+/* the state of one station; all times are in us on the system timer of the Pi */
+struct telemetryStation
+{
+  volatile uint32_t seq;
+  int32_t state;          // enum stationState of the game
+  int32_t games;          // games finished
+  int32_t attempts;       // rounds of the current game, including the one in progress
+  int32_t digits;         // digits entered in the current round
+  int32_t presses;        // presses of the digit being entered
+  int32_t lastExact;      // feedback of the last scored round (-1 before the first)
+  int32_t lastApprox;
+  uint64_t roundStart;    // when the current round began
+  uint64_t lastRoundTime; // how long the last scored round took
+  uint64_t lastWindow;    // how long after its last press the last digit was closed (0 before the first)
+  uint64_t updated;       // time of the last update
+};
+
+struct telemetryBlock
+{
+  uint32_t magic, version;
+  int32_t pid, stations;
+  uint64_t started;
+  struct telemetryStation station[TELEMETRY_STATIONS];
+};
+
+/* writer side of the seqlock: begin and end an update of @t@ */
+static inline void telemetryWriteBegin(struct telemetryStation *t)
+{
+  __atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void telemetryWriteEnd(struct telemetryStation *t)
+{
+  __atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* reader side: a consistent copy of @t@ into @out@; returns the number of retries it took, or -1 if there was no   */
+/* consistent copy within TELEMETRY_READ_TRIES tries (a writer that died in the middle of an update leaves @seq@   */
+/* odd for good), in which case @out@ may be torn                                                                  */
+static inline int telemetryRead(const struct telemetryStation *t, struct telemetryStation *out)
+{
+  uint32_t before, after;
+
+  for (int retries = 0; retries < TELEMETRY_READ_TRIES; retries++)
+  {
+    if ((before = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE)) & 1)
+      continue;
+    *out = *(const struct telemetryStation *)t;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+    if (before == after)
+      return retries;
+  }
+  return -1;
+}
+
+#endif